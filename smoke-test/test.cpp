@@ -5,6 +5,9 @@
 */
 
 #include <string>
+#include <mutex>
+#include <cmath>
+#include <algorithm>
 
 #include <robottestingframework/dll/Plugin.h>
 #include <robottestingframework/TestAssert.h>
@@ -22,8 +25,143 @@ using namespace yarp::sig;
 using namespace yarp::math;
 
 /**********************************************************************/
-class TestAssignmentGraspIt : public yarp::robottestingframework::TestCase,
-                              public PortReader
+class TrajectoryEvaluator : public PortReader
+{
+    mutex mtx;
+    Port *port;
+    Vector pose;
+    double target[3];
+    double proximity;
+
+    // finite differences are carried out on fixed-size
+    // buffers so that samples get processed without allocations
+    double p[3],v[3],a[3];
+    double t0,t;    // local clock
+    double t_stamp; // sender's clock
+    int samples;
+    bool hit;
+
+    double time_to_approach;
+    double path_length;
+    double peak_velocity;
+    double jerk_integral;
+    double idle_time;
+    double idle_threshold;
+
+    /******************************************************************/
+    bool read(ConnectionReader& reader) override
+    {
+        if (!pose.read(reader) || (pose.length()<3))
+            return false;
+
+        // the Cartesian state is stamped at the source, so that
+        // the transport jitter does not get into the derivatives
+        Stamp stamp;
+        bool stamped=(port!=nullptr) && port->getEnvelope(stamp) && stamp.isValid();
+
+        lock_guard<mutex> lck(mtx);
+        // only the derivatives rely on the stamps; timings
+        // wrt the start are all taken on the local clock
+        double now=Time::now();
+        double now_stamp=(stamped?stamp.getTime():now);
+        double dt=now_stamp-t_stamp;
+
+        double d2=0.0;
+        for (int i=0; i<3; i++)
+            d2+=(pose[i]-target[i])*(pose[i]-target[i]);
+        double d=sqrt(d2);
+        if (!hit && (d<proximity))
+        {
+            time_to_approach=now-t0;
+            hit=true;
+        }
+
+        if ((samples>0) && (dt>0.0))
+        {
+            double dl2=0.0,v2=0.0,j2=0.0;
+            for (int i=0; i<3; i++)
+            {
+                double vi=(pose[i]-p[i])/dt;
+                double ai=(vi-v[i])/dt;
+                double ji=(ai-a[i])/dt;
+                dl2+=(pose[i]-p[i])*(pose[i]-p[i]);
+                v2+=vi*vi;
+                if (samples>2)
+                    j2+=ji*ji;
+                v[i]=vi;
+                a[i]=ai;
+            }
+
+            double speed=sqrt(v2);
+            path_length+=sqrt(dl2);
+            peak_velocity=std::max(peak_velocity,speed);
+            jerk_integral+=j2*dt;
+            if (speed<idle_threshold)
+                idle_time+=dt;
+        }
+
+        for (int i=0; i<3; i++)
+            p[i]=pose[i];
+        t=now;
+        t_stamp=now_stamp;
+        samples++;
+        return true;
+    }
+
+public:
+    /******************************************************************/
+    TrajectoryEvaluator() : port(nullptr), proximity(0.1), idle_threshold(0.005)
+    {
+        start(Vector(3,0.0));
+    }
+
+    /******************************************************************/
+    void listen(Port& port)
+    {
+        this->port=&port;
+        port.setReader(*this);
+    }
+
+    /******************************************************************/
+    void start(const Vector& target)
+    {
+        lock_guard<mutex> lck(mtx);
+        for (int i=0; i<3; i++)
+        {
+            this->target[i]=target[i];
+            p[i]=v[i]=a[i]=0.0;
+        }
+        t0=t=t_stamp=Time::now();
+        samples=0;
+        hit=false;
+        time_to_approach=-1.0;
+        path_length=peak_velocity=0.0;
+        jerk_integral=idle_time=0.0;
+    }
+
+    /******************************************************************/
+    bool hasHit()
+    {
+        lock_guard<mutex> lck(mtx);
+        return hit;
+    }
+
+    /******************************************************************/
+    string report()
+    {
+        lock_guard<mutex> lck(mtx);
+        double duration=t-t0;
+        return Asserter::format("time-to-approach = %g [s]; path length = %g [m]; "
+                                "peak velocity = %g [m/s]; RMS jerk = %g [m/s^3]; "
+                                "idle time = %g [s] over %g [s] (%d samples)",
+                                time_to_approach,path_length,peak_velocity,
+                                (duration>0.0?sqrt(jerk_integral/duration):0.0),
+                                idle_time,duration,samples);
+    }
+};
+
+/**********************************************************************/
+class TestAssignmentGraspIt : public yarp::robottestingframework::TestCase
 {
     RpcClient portBall;
     RpcClient portGI;
@@ -31,7 +169,8 @@ class TestAssignmentGraspIt : public yarp::robottestingframework::TestCase,
     Port      portHandL;
 
     Vector ballPosRobFrame;
-    bool hit;
+    TrajectoryEvaluator evalHandR;
+    TrajectoryEvaluator evalHandL;
 
     /******************************************************************/
     Vector getBallPosition()
@@ -74,8 +213,7 @@ class TestAssignmentGraspIt : public yarp::robottestingframework::TestCase,
 public:
     /******************************************************************/
     TestAssignmentGraspIt() :
-        yarp::robottestingframework::TestCase("TestAssignmentGraspIt"),
-        hit(false)
+        yarp::robottestingframework::TestCase("TestAssignmentGraspIt")
     {
     }
 
@@ -88,15 +226,20 @@ public:
     virtual bool setup(yarp::os::Property& property)
     {
         string robot=property.check("robot",Value("icubSim")).asString();
+        string prefix=property.check("prefix",Value("")).asString();
+        string carrier=property.check("carrier",Value("tcp")).asString();
         float rpcTmo=(float)property.check("rpc-timeout",Value(240.0)).asFloat64();
 
         string robotPortRName("/"+robot+"/cartesianController/right_arm/state:o");
         string robotPortLName("/"+robot+"/cartesianController/left_arm/state:o");
 
-        string portBallName("/"+getName()+"/ball:rpc");
-        string portGIName("/"+getName()+"/gi:rpc");
-        string portHandRName("/"+getName()+"/hand/right:i");
-        string portHandLName("/"+getName()+"/hand/left:i");
+        string worldPortName(prefix+"/assignment_grasp-it-ball/rpc");
+        string servicePortName(prefix+"/service");
+
+        string portBallName(prefix+"/"+getName()+"/ball:rpc");
+        string portGIName(prefix+"/"+getName()+"/gi:rpc");
+        string portHandRName(prefix+"/"+getName()+"/hand/right:i");
+        string portHandLName(prefix+"/"+getName()+"/hand/left:i");
 
         portBall.open(portBallName);
         portGI.open(portGIName);
@@ -109,18 +252,18 @@ public:
 
         Time::delay(5.0);
 
-        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Connecting Ports");
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Connecting Ports via %s",carrier.c_str()));
 
-        if (!Network::connect(portBallName,"/assignment_grasp-it-ball/rpc"))
-            ROBOTTESTINGFRAMEWORK_ASSERT_FAIL("Unable to connect to /assignment_grasp-it-ball/rpc");
+        if (!Network::connect(portBallName,worldPortName,carrier))
+            ROBOTTESTINGFRAMEWORK_ASSERT_FAIL(Asserter::format("Unable to connect to %s",worldPortName.c_str()));
 
-        if (!Network::connect(portGIName,"/service"))
-            ROBOTTESTINGFRAMEWORK_ASSERT_FAIL("Unable to connect to /service");
+        if (!Network::connect(portGIName,servicePortName,carrier))
+            ROBOTTESTINGFRAMEWORK_ASSERT_FAIL(Asserter::format("Unable to connect to %s",servicePortName.c_str()));
 
-        if (!Network::connect(robotPortRName,portHandRName))
+        if (!Network::connect(robotPortRName,portHandRName,carrier))
             ROBOTTESTINGFRAMEWORK_ASSERT_FAIL(Asserter::format("Unable to connect to %s",robotPortRName.c_str()));
 
-        if (!Network::connect(robotPortLName,portHandLName))
+        if (!Network::connect(robotPortLName,portHandLName,carrier))
             ROBOTTESTINGFRAMEWORK_ASSERT_FAIL(Asserter::format("Unable to connect to %s",robotPortLName.c_str()));
 
         Rand::init();
@@ -138,30 +281,6 @@ public:
         portHandR.close();
     }
 
-    /******************************************************************/
-    virtual bool read(ConnectionReader& reader)
-    {
-        if (!hit)
-        {
-            Bottle data;
-            data.read(reader);
-
-            Vector x(3);
-            x[0]=data.get(0).asFloat64();
-            x[1]=data.get(1).asFloat64();
-            x[2]=data.get(2).asFloat64();
-
-            double d=norm(ballPosRobFrame-x);
-            if (d<0.1)
-            {
-                ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Great! We're at %g [m] from the ball",d));
-                hit=true;
-            }
-        }
-
-        return true;
-    }
-
     /******************************************************************/
     virtual void run()
     {
@@ -196,8 +315,10 @@ public:
         cmd.clear(); reply.clear();
 
         ROBOTTESTINGFRAMEWORK_TEST_REPORT("Proximity check is now active");
-        portHandR.setReader(*this);
-        portHandL.setReader(*this);
+        evalHandR.start(ballPosRobFrame);
+        evalHandL.start(ballPosRobFrame);
+        evalHandR.listen(portHandR);
+        evalHandL.listen(portHandL);
 
         cmd.addString("grasp_it");
         if (!portGI.write(cmd,reply))
@@ -211,6 +332,10 @@ public:
         ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("final ball position = (%s) [m]",
                                           finalBallPos.toString(3,3).c_str()));
 
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("right hand: "+evalHandR.report());
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("left hand: "+evalHandL.report());
+
+        bool hit=evalHandR.hasHit() || evalHandL.hasHit();
         double d=finalBallPos[2]-initialBallPos[2];
         ROBOTTESTINGFRAMEWORK_TEST_CHECK(hit,"We've approached the ball!");
         ROBOTTESTINGFRAMEWORK_TEST_CHECK(d>=0.02,Asserter::format("Ball has been lifted for at least %g [m]!",d));
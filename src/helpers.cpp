@@ -4,6 +4,8 @@
 
 #include <yarp/os/Vocab.h>
 #include <yarp/os/Bottle.h>
+#include <yarp/os/Time.h>
+#include <yarp/os/Network.h>
 #include <yarp/os/LogStream.h>
 #include <yarp/sig/Matrix.h>
 #include <yarp/math/Math.h>
@@ -16,15 +18,52 @@ using namespace yarp::math;
 
 
 /***************************************************/
-ObjectRetriever::ObjectRetriever() : simulation(false)
+ObjectRetriever::ObjectRetriever() : simulation(false), margin(0.05)
 {
-    portLocation.open("/location");
-    portCalibration.open("/calibration");
+}
+
+/***************************************************/
+bool ObjectRetriever::connect(const string &remoteLocation,
+                              const string &remoteCalibration,
+                              const string &carrier)
+{
+    // on the same host, carriers such as shmem or unix_stream
+    // cut down the latency of the queries wrt tcp
+    bool ok=true;
+    if (!remoteLocation.empty())
+        ok&=Network::connect(portLocation.getName(),remoteLocation,carrier);
+    if (!remoteCalibration.empty())
+        ok&=Network::connect(portCalibration.getName(),remoteCalibration,carrier);
+
+    if (!ok)
+        yError()<<"Unable to connect the object retriever via"<<carrier;
+    return ok;
+}
+
+/***************************************************/
+void ObjectRetriever::setMargin(const double margin)
+{
+    this->margin=margin;
+}
+
+/***************************************************/
+bool ObjectRetriever::open(const string &prefix)
+{
+    if (!portLocation.open(prefix+"/location"))
+        return false;
+
+    if (!portCalibration.open(prefix+"/calibration"))
+    {
+        portLocation.close();
+        return false;
+    }
 
     portLocation.asPort().setTimeout(1.0);
     portCalibration.asPort().setTimeout(1.0);
 
     portLocation.setReporter(*this);
+    portCalibration.setReporter(*this);
+    return true;
 }
 
 /***************************************************/
@@ -32,6 +71,76 @@ ObjectRetriever::~ObjectRetriever()
 {
     portLocation.close();
     portCalibration.close();
+
+    lock_guard<mutex> lck(mtx_recorder);
+    if (recorder.is_open())
+        recorder.close();
+}
+
+/***************************************************/
+bool ObjectRetriever::record(const string &file)
+{
+    lock_guard<mutex> lck(mtx_recorder);
+    recorder.open(file.c_str());
+    if (!recorder.is_open())
+    {
+        yError()<<"Unable to open \""<<file<<"\" for recording";
+        return false;
+    }
+
+    yInfo()<<"Recording location queries to \""<<file<<'\"';
+    return true;
+}
+
+/***************************************************/
+void ObjectRetriever::logEntry(const Bottle &entry)
+{
+    lock_guard<mutex> lck(mtx_recorder);
+    if (recorder.is_open())
+    {
+        Bottle line;
+        line.addFloat64(Time::now());
+        line.append(entry);
+        recorder<<line.toString()<<endl;
+    }
+}
+
+/***************************************************/
+bool ObjectRetriever::query(RpcClient &port, const string &tag,
+                            const Bottle &cmd, Bottle &reply,
+                            const bool log)
+{
+    bool ret=port.write(cmd,reply);
+    if (log)
+        logQuery(tag,cmd,ret?reply:Bottle());
+    return ret;
+}
+
+/***************************************************/
+void ObjectRetriever::logQuery(const string &tag, const Bottle &cmd,
+                               const Bottle &reply)
+{
+    // each line of the log reads as:
+    // <stamp> <tag> (<command>) (<reply>)
+    Bottle entry;
+    entry.addString(tag);
+    entry.addList()=cmd;
+    entry.addList()=reply;
+    logEntry(entry);
+}
+
+/***************************************************/
+void ObjectRetriever::logConnection(const string &tag, const string &target,
+                                    const string &source)
+{
+    // <stamp> connect <tag> <target> [<source>]
+    Bottle entry;
+    entry.addString("connect");
+    entry.addString(tag);
+    entry.addString(target);
+    if (!source.empty())
+        entry.addString(source);
+    logEntry(entry);
 }
 
 /***************************************************/
@@ -39,14 +148,27 @@ void ObjectRetriever::report(const PortInfo &info)
 {
     if (info.created && !info.incoming)
     {
-        simulation=(info.targetName=="/assignment_grasp-it-ball/rpc");
-        yInfo()<<"We are talking to "<<(simulation?"icubSim":"icub");
+        string tag=(info.sourceName==portLocation.getName()?"location":"calibration");
+        if (tag=="location")
+        {
+            // the world may live within its own namespace
+            string ball="/assignment_grasp-it-ball/rpc";
+            simulation=(info.targetName.size()>=ball.size()) &&
+                       (info.targetName.compare(info.targetName.size()-ball.size(),
+                                                ball.size(),ball)==0);
+            yInfo()<<"We are talking to "<<(simulation?"icubSim":"icub");
+        }
+
+        // keep track of the peers so that
+        // the replay can stand in for them
+        logConnection(tag,info.targetName,info.sourceName);
     }
 }
 
 /***************************************************/
 bool ObjectRetriever::calibrate(Vector &location,
-                                const string &hand)
+                                const string &hand,
+                                const bool log)
 {
     if ((portCalibration.getOutputCount()>0) &&
         (location.length()>=3))
@@ -57,7 +179,7 @@ bool ObjectRetriever::calibrate(Vector &location,
         cmd.addFloat64(location[0]);
         cmd.addFloat64(location[1]);
         cmd.addFloat64(location[2]);
-        portCalibration.write(cmd,reply);
+        query(portCalibration,"calibration",cmd,reply,log);
 
         location.resize(3);
         location[0]=reply.get(1).asFloat64();
@@ -72,6 +194,27 @@ bool ObjectRetriever::calibrate(Vector &location,
 /***************************************************/
 bool ObjectRetriever::getLocation(Vector &location,
                                   const string &hand)
+{
+    if (retrieve(location,hand,true))
+        return true;
+
+    yError()<<"Unable to retrieve location";
+    return false;
+}
+
+/***************************************************/
+bool ObjectRetriever::trackLocation(Vector &location,
+                                    const string &hand)
+{
+    // high-rate queries are kept out of the log and left to
+    // the caller to report, so as not to flood the recording
+    return retrieve(location,hand,false);
+}
+
+/***************************************************/
+bool ObjectRetriever::retrieve(Vector &location,
+                               const string &hand,
+                               const bool log)
 {
     if (portLocation.getOutputCount()>0)
     {
@@ -79,7 +222,7 @@ bool ObjectRetriever::getLocation(Vector &location,
         if (simulation)
         {
             cmd.addString("get");
-            if (portLocation.write(cmd,reply))
+            if (query(portLocation,"location",cmd,reply,log))
             {
                 if (reply.size()>=4)
                 {
@@ -94,7 +237,7 @@ bool ObjectRetriever::getLocation(Vector &location,
                         location[2]-=0.63;
 
                         // apply some safe margin
-                        location[2]+=0.05;
+                        location[2]+=margin;
                         return true;
                     }
                 }
@@ -107,7 +250,7 @@ bool ObjectRetriever::getLocation(Vector &location,
             content.addString("name");
             content.addString("==");
             content.addString("Toy");
-            portLocation.write(cmd,reply);
+            query(portLocation,"location",cmd,reply,log);
 
             if (reply.size()>1)
             {
@@ -130,7 +273,7 @@ bool ObjectRetriever::getLocation(Vector &location,
                             Bottle &list_items=list_propSet.addList();
                             list_items.addString("position_3d");
                             Bottle replyProp;
-                            portLocation.write(cmd,replyProp);
+                            query(portLocation,"location",cmd,replyProp,log);
 
                             if (replyProp.get(0).asVocab32()==Vocab32::encode("ack"))
                             {
@@ -144,7 +287,7 @@ bool ObjectRetriever::getLocation(Vector &location,
                                             location[0]=position_3d->get(0).asFloat64();
                                             location[1]=position_3d->get(1).asFloat64();
                                             location[2]=position_3d->get(2).asFloat64();
-                                            if (calibrate(location,hand))
+                                            if (calibrate(location,hand,log))
                                                 return true;
                                         }
                                     }
@@ -157,6 +300,29 @@ bool ObjectRetriever::getLocation(Vector &location,
         }
     }
 
-    yError()<<"Unable to retrieve location";
+    return false;
+}
+
+/***************************************************/
+bool ObjectRetriever::getGraspState(GraspState &state)
+{
+    // only the simulator can tell us about contacts
+    if (simulation && (portLocation.getOutputCount()>0))
+    {
+        Bottle cmd,reply;
+        cmd.addString("grasp_state");
+        if (query(portLocation,"location",cmd,reply))
+        {
+            if ((reply.size()>=5) && (reply.get(0).asVocab32()==Vocab32::encode("ack")))
+            {
+                state.contact=(reply.get(1).asInt32()!=0);
+                state.fingers=reply.get(2).asInt32();
+                state.slipping=(reply.get(3).asInt32()!=0);
+                state.lifted=reply.get(4).asFloat64();
+                return true;
+            }
+        }
+    }
+
     return false;
 }
@@ -6,22 +6,55 @@
 #define HELPERS_H
 
 #include <string>
+#include <fstream>
+#include <mutex>
 #include <yarp/os/PortReport.h>
 #include <yarp/os/PortInfo.h>
+#include <yarp/os/Bottle.h>
 #include <yarp/os/RpcClient.h>
 #include <yarp/sig/Vector.h>
 
+struct GraspState
+{
+    bool contact;
+    int fingers;
+    bool slipping;
+    double lifted;
+};
+
 class ObjectRetriever : yarp::os::PortReport
 {
     bool simulation;
+    double margin;
     yarp::os::RpcClient portLocation;
     yarp::os::RpcClient portCalibration;
+    std::mutex mtx_recorder;
+    std::ofstream recorder;
+    void logEntry(const yarp::os::Bottle &entry);
     virtual void report(const yarp::os::PortInfo &info);
-    bool calibrate(yarp::sig::Vector &location, const std::string &hand);
+    bool query(yarp::os::RpcClient &port, const std::string &tag,
+               const yarp::os::Bottle &cmd, yarp::os::Bottle &reply,
+               const bool log=true);
+    bool calibrate(yarp::sig::Vector &location, const std::string &hand,
+                   const bool log);
+    bool retrieve(yarp::sig::Vector &location, const std::string &hand,
+                  const bool log);
 
 public:
     ObjectRetriever();
+    bool open(const std::string &prefix="");
+    bool connect(const std::string &remoteLocation,
+                 const std::string &remoteCalibration,
+                 const std::string &carrier="tcp");
+    bool record(const std::string &file);
+    void logConnection(const std::string &tag, const std::string &target,
+                       const std::string &source="");
+    void logQuery(const std::string &tag, const yarp::os::Bottle &cmd,
+                  const yarp::os::Bottle &reply);
+    void setMargin(const double margin);
     bool getLocation(yarp::sig::Vector &location, const std::string &hand="dummy");
+    bool trackLocation(yarp::sig::Vector &location, const std::string &hand="dummy");
+    bool getGraspState(GraspState &state);
     virtual ~ObjectRetriever();
 };
 
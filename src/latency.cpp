@@ -0,0 +1,105 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+
+using namespace std;
+using namespace yarp::os;
+
+
+/***************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    if (!yarp.checkNetwork())
+    {
+        yError()<<"YARP doesn't seem to be available";
+        return 1;
+    }
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        yInfo()<<"Options:";
+        yInfo()<<"--remote <port>           rpc port to query (default = /assignment_grasp-it-ball/rpc)";
+        yInfo()<<"--command \"(<cmd>)\"       command to send (default = (get))";
+        yInfo()<<"--carriers \"(<c1> ...)\"   carriers to compare (default = (tcp fast_tcp unix_stream shmem))";
+        yInfo()<<"--samples <n>             queries per carrier (default = 1000)";
+        yInfo()<<"--prefix <name>           namespace of the local port (default = none)";
+        return 0;
+    }
+
+    string remote=rf.check("remote",Value("/assignment_grasp-it-ball/rpc")).asString();
+    int samples=rf.check("samples",Value(1000)).asInt32();
+    string prefix=rf.check("prefix",Value("")).asString();
+
+    Bottle cmd;
+    if (Bottle *b=rf.find("command").asList())
+        cmd=*b;
+    else
+        cmd.addString("get");
+
+    Bottle carriers;
+    if (Bottle *b=rf.find("carriers").asList())
+        carriers=*b;
+    else
+        carriers.fromString("tcp fast_tcp unix_stream shmem");
+
+    RpcClient port;
+    if (!port.open(prefix+"/assignment_grasp-it-latency/rpc"))
+        return 1;
+    port.asPort().setTimeout(1.0);
+
+    vector<double> rtt;
+    rtt.reserve(samples);
+    for (size_t i=0; i<carriers.size(); i++)
+    {
+        string carrier=carriers.get(i).asString();
+        if (!Network::connect(port.getName(),remote,carrier))
+        {
+            yWarning()<<"Unable to connect to"<<remote<<"via"<<carrier;
+            continue;
+        }
+
+        rtt.clear();
+        int failures=0;
+        for (int k=0; k<samples; k++)
+        {
+            Bottle reply;
+            double t0=Time::now();
+            if (port.write(cmd,reply))
+                rtt.push_back(Time::now()-t0);
+            else
+                failures++;
+        }
+        Network::disconnect(port.getName(),remote);
+
+        if (rtt.empty())
+        {
+            yWarning()<<carrier<<": no replies";
+            continue;
+        }
+
+        sort(rtt.begin(),rtt.end());
+        double mean=0.0;
+        for (auto &t:rtt)
+            mean+=t;
+        mean/=rtt.size();
+
+        yInfo()<<carrier<<": mean ="<<1e6*mean
+               <<"[us], median ="<<1e6*rtt[rtt.size()/2]
+               <<"[us], p99 ="<<1e6*rtt[(99*rtt.size())/100]
+               <<"[us], max ="<<1e6*rtt.back()
+               <<"[us], failures ="<<failures;
+    }
+
+    port.close();
+    return 0;
+}
@@ -12,6 +12,8 @@
 #include <yarp/math/Math.h>
 
 #include "helpers.h"
+#include "servo.h"
+#include "planner.h"
 
 using namespace std;
 using namespace yarp::os;
@@ -31,13 +33,74 @@ protected:
     int startup_ctxt_arm_right;
     int startup_ctxt_arm_left;
     int startup_ctxt_gaze;
-
+    Vector home_x_right,home_o_right;
+    Vector home_x_left,home_o_left;
+
+    // grasp parameters
+    double via_height;
+    double tilt;
+    double pre_shape_abduction;
+    double pre_shape_thumb;
+    double pre_shape_fingers;
+    double default_closure;
+    int grasp_min_fingers;
+    int grasp_retries;
+
+    // closed-loop final approach
+    bool servo;
+    double servo_rate;
+    double servo_distance;
+    Property servo_options;
+    string servo_report;
+
+    // scoring of multiple approach candidates
+    bool planner;
+    Property planner_options;
+
+    // poses for chaining grasps, given for the right hand
+    // and mirrored about the xz-plane for the left hand
+    Vector place_pos;
+    Vector ready_pos;
+    string holding_hand;
+
+    // release() does not wait for the arm to get back to the ready pose:
+    // the next motion of that arm waits for it, unless it takes over
+    string pending_hand;
+
+    // whether the last grasp failed with the object in sight
+    bool missed;
+
+    // in replay mode, no device gets opened and the motions are
+    // skipped, so that only the control logic runs against the
+    // peers stood in by assignment_grasp-it-replay
+    bool replay;
+
+    string prefix;
     RpcServer rpcPort;
     ObjectRetriever object;
 
+    /***************************************************/
+    void waitPending(const string &hand)
+    {
+        if (pending_hand!=hand)
+            return;
+
+        ICartesianControl *iarm_pending;
+        if (hand=="right")
+            drvArmR.view(iarm_pending);
+        else
+            drvArmL.view(iarm_pending);
+        if (!replay)
+            iarm_pending->waitMotionDone();
+        pending_hand.clear();
+    }
+
     /***************************************************/
     void fixate(const Vector &x)
     {
+        if (replay)
+            return;
+
         // simply look at x,
         // but when the movement is over
         // ensure that we'll still be looking at x
@@ -54,7 +117,7 @@ protected:
 
         // FILL IN THE CODE
 
-        // add up a further slight rotation (30 deg) around -y:
+        // add up a further slight rotation (tilt deg, 30 by default) around -y:
         // this will prevent the thumb from hitting the table
 
         // FILL IN THE CODE
@@ -65,8 +128,13 @@ protected:
     /***************************************************/
     void approachTargetWithHand(const string &hand,
                                 const Vector &x,
-                                const Vector &o)
+                                const Vector &o,
+                                const double via)
     {
+        waitPending(hand);
+        if (replay)
+            return;
+
         // select the correct interface
         if (hand=="right")
             drvArmR.view(iarm);
@@ -78,7 +146,7 @@ protected:
         // FILL IN THE CODE
 
         // reach the first via-point
-        // located 5 cm above the target x
+        // located via (via_height, 5 cm by default) above the target x
 
         // FILL IN THE CODE
 
@@ -87,9 +155,42 @@ protected:
         // FILL IN THE CODE
     }
 
+    /***************************************************/
+    bool servoTargetWithHand(const string &hand,
+                             const Vector &o)
+    {
+        waitPending(hand);
+        if (replay)
+            return true;
+
+        // select the correct interface
+        if (hand=="right")
+            drvArmR.view(iarm);
+        else
+            drvArmL.view(iarm);
+
+        // track the latest estimate of the object
+        // driving the arm in velocity mode
+        ServoThread servoThread(1.0/servo_rate,iarm,object,hand,o,servo_options);
+        if (!servoThread.start())
+            return false;
+
+        while (!servoThread.isDone())
+            Time::delay(0.01);
+        servoThread.stop();
+
+        servo_report=servoThread.report();
+        yInfo()<<servo_report;
+        return servoThread.hasReached();
+    }
+
     /***************************************************/
     void liftObject(const string &hand)
     {
+        waitPending(hand);
+        if (replay)
+            return;
+
         // select the correct interface
         if (hand=="right")
             drvArmR.view(iarm);
@@ -107,6 +208,9 @@ protected:
                      const VectorOf<int> &joints,
                      const double fingers_closure)
     {
+        if (replay)
+            return;
+
         // select the correct interface
         IControlLimits   *ilim;
         IControlMode     *imod;
@@ -145,6 +249,9 @@ protected:
     /***************************************************/
     void look_down()
     {
+        if (replay)
+            return;
+
         // we ask the controller to keep the vergence
         // from now on fixed at 5.0 deg, which is the
         // configuration where we calibrated the stereo-vision;
@@ -158,10 +265,119 @@ protected:
     }
 
     /***************************************************/
-    bool grasp_it(const double fingers_closure)
+    Vector mirror(const Vector &pos, const string &hand)
     {
-        Vector x; string hand;
-        if (object.getLocation(x))
+        Vector x=pos;
+        x[1]=(hand=="right"?fabs(pos[1]):-fabs(pos[1]));
+        return x;
+    }
+
+    /***************************************************/
+    void stageHand(const string &hand, const Vector &x,
+                   const Vector &o, const double via)
+    {
+        // the staging takes over the motion toward the ready pose
+        if (pending_hand==hand)
+            pending_hand.clear();
+        if (replay)
+            return;
+
+        // select the correct interface
+        if (hand=="right")
+            drvArmR.view(iarm);
+        else
+            drvArmL.view(iarm);
+
+        // start moving toward the via-point without waiting:
+        // the approach will then take over the ongoing motion
+        Vector xa=x;
+        xa[2]+=via;
+        iarm->goToPose(xa,o);
+    }
+
+    /***************************************************/
+    bool release(Vector *location=nullptr)
+    {
+        if (holding_hand.empty())
+            return false;
+
+        string hand=holding_hand;
+        waitPending(hand);
+        if (hand=="right")
+            drvArmR.view(iarm);
+        else
+            drvArmL.view(iarm);
+
+        Vector o=computeHandOrientation(hand);
+        if (!replay)
+        {
+            iarm->goToPoseSync(mirror(place_pos,hand),o);
+            iarm->waitMotionDone();
+        }
+        yInfo()<<"reached place pose";
+
+        VectorOf<int> fingers;
+        for (int i=9; i<16; i++)
+            fingers.push_back(i);
+        moveFingers(hand,fingers,pre_shape_fingers);
+        holding_hand.clear();
+        yInfo()<<"released";
+
+        // go back to the ready pose while the next
+        // request gets in: no need to wait here
+        if (!replay)
+            iarm->goToPose(mirror(ready_pos,hand),o);
+        pending_hand=hand;
+        yInfo()<<"moving to ready pose";
+
+        // with the object out of the hand, we can
+        // localize the next one while on the move
+        if ((location!=nullptr) && !object.getLocation(*location))
+            location->clear();
+        return true;
+    }
+
+    /***************************************************/
+    void home()
+    {
+        holding_hand.clear();
+        pending_hand.clear();
+        if (replay)
+            return;
+
+        // open both hands
+        VectorOf<int> fingers;
+        for (int i=9; i<16; i++)
+            fingers.push_back(i);
+        moveFingers("right",fingers,0.0);
+        moveFingers("left",fingers,0.0);
+
+        // bring the arms back to the startup poses
+        // along with the startup settings
+        ICartesianControl *iarmR,*iarmL;
+        drvArmR.view(iarmR);
+        drvArmL.view(iarmL);
+        iarmR->restoreContext(startup_ctxt_arm_right);
+        iarmL->restoreContext(startup_ctxt_arm_left);
+        iarmR->goToPose(home_x_right,home_o_right);
+        iarmL->goToPose(home_x_left,home_o_left);
+        iarmR->waitMotionDone();
+        iarmL->waitMotionDone();
+
+        igaze->restoreContext(startup_ctxt_gaze);
+    }
+
+    /***************************************************/
+    bool grasp_it(const double fingers_closure, const bool staged=false,
+                  const Vector &location=Vector())
+    {
+        missed=false;
+
+        // the coarse location may be already available;
+        // the planner may change the via-point for this grasp only
+        Vector x=location,o; string hand;
+        double via=via_height;
+        if ((x.length()>=3) || object.getLocation(x))
         {
             yInfo()<<"retrieved 3D location = ("<<x.toString(3,3)<<")";
 
@@ -172,6 +388,35 @@ protected:
         else
             return false;
 
+        // score a set of approaches with both hands
+        // and override the selection with the best one
+        // (the solvers are not available in replay)
+        if (planner && !replay)
+        {
+            ICartesianControl *iarmR,*iarmL;
+            drvArmR.view(iarmR);
+            drvArmL.view(iarmL);
+
+            GraspPlanner gp(iarmR,iarmL,via_height,planner_options);
+            GraspCandidate best;
+            if (gp.plan(x,computeHandOrientation("right"),
+                        computeHandOrientation("left"),best))
+            {
+                hand=best.hand;
+                o=best.o;
+                via=best.via_height;
+                yInfo()<<"planned hand = \""<<hand<<'\"';
+            }
+        }
+
+        // overlap the arm motion with fixation,
+        // localization refinement and hand pre-shaping
+        if (staged)
+        {
+            stageHand(hand,x,(o.length()>0?o:computeHandOrientation(hand)),via);
+            yInfo()<<"staging hand above ("<<x.toString(3,3)<<")";
+        }
+
         fixate(x);
         yInfo()<<"fixating at ("<<x.toString(3,3)<<")";
 
@@ -181,7 +426,8 @@ protected:
         {
             yInfo()<<"refined 3D location = ("<<x.toString(3,3)<<")";
 
-            Vector o=computeHandOrientation(hand);
+            if (o.length()==0)
+                o=computeHandOrientation(hand);
             yInfo()<<"computed orientation = ("<<o.toString(3,3)<<")";
 
             // we set up here the lists of joints we need to actuate
@@ -192,19 +438,59 @@ protected:
                 fingers.push_back(i);
 
             // let's put the hand in the pre-grasp configuration
-            moveFingers(hand,abduction,0.7);
-            moveFingers(hand,thumb,1.0);
-            moveFingers(hand,fingers,0.0);
+            moveFingers(hand,abduction,pre_shape_abduction);
+            moveFingers(hand,thumb,pre_shape_thumb);
+            moveFingers(hand,fingers,pre_shape_fingers);
             yInfo()<<"prepared hand";
 
-            approachTargetWithHand(hand,x,o);
-            yInfo()<<"approached object";
-
-            moveFingers(hand,fingers,fingers_closure);
-            yInfo()<<"grasped";
+            for (int attempt=0; ; attempt++)
+            {
+                if (servo)
+                {
+                    // go open-loop up to servo_distance above the object,
+                    // then close the loop over the last centimeters
+                    Vector xs=x;
+                    xs[2]+=servo_distance;
+                    approachTargetWithHand(hand,xs,o,via);
+                    if (!servoTargetWithHand(hand,o))
+                        yWarning()<<"servo did not converge";
+                }
+                else
+                    approachTargetWithHand(hand,x,o,via);
+                yInfo()<<"approached object";
+
+                moveFingers(hand,fingers,fingers_closure);
+                yInfo()<<"grasped";
+
+                // when the world can tell us about contacts,
+                // we check the grasp before lifting the object
+                GraspState state;
+                if (!object.getGraspState(state) || (state.fingers>=grasp_min_fingers))
+                    break;
+
+                yWarning()<<"grasp failed with"<<state.fingers<<"finger(s) in contact";
+
+                // reopen the hand in any case
+                moveFingers(hand,fingers,pre_shape_fingers);
+                if (attempt>=grasp_retries)
+                {
+                    missed=true;
+                    return false;
+                }
+
+                // retry from the updated location
+                object.getLocation(x,hand);
+                yInfo()<<"retrying at ("<<x.toString(3,3)<<")";
+            }
 
             liftObject(hand);
             yInfo()<<"lifted";
+
+            GraspState state;
+            if (object.getGraspState(state) && (!state.contact || state.slipping))
+                yWarning()<<"object is slipping away, lifted by"<<state.lifted<<"[m]";
+
+            holding_hand=hand;
             return true;
         }
         return false;
@@ -218,7 +504,7 @@ protected:
         Property optArm;
         optArm.put("device","cartesiancontrollerclient");
         optArm.put("remote","/"+robot+"/cartesianController/"+arm);
-        optArm.put("local","/cartesian_client/"+arm);
+        optArm.put("local",prefix+"/cartesian_client/"+arm);
 
         // let's give the controller some time to warm up
         bool ok=false;
@@ -244,12 +530,9 @@ protected:
         return true;
     }
 
-public:
     /***************************************************/
-    bool configure(ResourceFinder &rf)
+    bool openDevices(const string &robot)
     {
-        string robot=rf.check("robot",Value("icubSim")).asString();
-
         if (!openCartesian(robot,"right_arm"))
             return false;
 
@@ -259,20 +542,110 @@ public:
             return false;
         }
 
+        // the local ports of the remaining clients
+        // are expected to live within prefix too
+
         // FILL IN THE CODE
 
-        // save startup contexts
+        // save startup contexts and poses
         drvArmR.view(iarm);
         iarm->storeContext(&startup_ctxt_arm_right);
+        iarm->getPose(home_x_right,home_o_right);
 
         drvArmL.view(iarm);
         iarm->storeContext(&startup_ctxt_arm_left);
+        iarm->getPose(home_x_left,home_o_left);
 
         drvGaze.view(igaze);
         igaze->storeContext(&startup_ctxt_gaze);
+        return true;
+    }
+
+public:
+    /***************************************************/
+    bool configure(ResourceFinder &rf)
+    {
+        string robot=rf.check("robot",Value("icubSim")).asString();
+
+        // all our ports live within this namespace
+        // (e.g. "/service" becomes "<prefix>/service")
+        prefix=rf.check("prefix",Value("")).asString();
+
+        // run offline against a recording
+        // (see assignment_grasp-it-replay)
+        replay=rf.check("replay");
+        missed=false;
+
+        // the grasp can be tuned from outside
+        // (see assignment_grasp-it-tuner)
+        via_height=rf.check("via-height",Value(0.05)).asFloat64();
+        tilt=rf.check("tilt",Value(30.0)).asFloat64();
+        pre_shape_abduction=rf.check("pre-shape-abduction",Value(0.7)).asFloat64();
+        pre_shape_thumb=rf.check("pre-shape-thumb",Value(1.0)).asFloat64();
+        pre_shape_fingers=rf.check("pre-shape-fingers",Value(0.0)).asFloat64();
+        default_closure=rf.check("closure",Value(0.0)).asFloat64();
+        grasp_min_fingers=rf.check("grasp-min-fingers",Value(2)).asInt32();
+        grasp_retries=rf.check("grasp-retries",Value(1)).asInt32();
+
+        servo=rf.check("servo");
+        servo_rate=std::max(100.0,rf.check("servo-rate",Value(100.0)).asFloat64());
+        servo_distance=rf.check("servo-distance",Value(0.04)).asFloat64();
+        servo_options.put("gain",rf.check("servo-gain",Value(3.0)).asFloat64());
+        servo_options.put("max-speed",rf.check("servo-max-speed",Value(0.1)).asFloat64());
+        servo_options.put("tolerance",rf.check("servo-tolerance",Value(0.005)).asFloat64());
+        servo_options.put("timeout",rf.check("servo-timeout",Value(5.0)).asFloat64());
+        servo_options.put("tracker-period",rf.check("servo-tracker-period",Value(0.1)).asFloat64());
+
+        planner=rf.check("planner");
+        if (rf.check("planner-threads"))
+            planner_options.put("threads",rf.find("planner-threads").asInt32());
+        if (rf.check("planner-prune-residual"))
+            planner_options.put("prune-residual",rf.find("planner-prune-residual").asFloat64());
+        for (auto &key:{"yaws","tilts","via-heights"})
+            if (rf.find(string("planner-")+key).isList())
+                planner_options.put(key,rf.find(string("planner-")+key));
+        object.setMargin(rf.check("margin",Value(0.05)).asFloat64());
+
+        place_pos.resize(3);
+        place_pos[0]=-0.30; place_pos[1]=0.25; place_pos[2]=0.05;
+        if (Bottle *b=rf.find("place").asList())
+            for (size_t i=0; i<std::min(place_pos.length(),b->size()); i++)
+                place_pos[i]=b->get(i).asFloat64();
+
+        ready_pos.resize(3);
+        ready_pos[0]=-0.30; ready_pos[1]=0.15; ready_pos[2]=0.10;
+        if (Bottle *b=rf.find("ready").asList())
+            for (size_t i=0; i<std::min(ready_pos.length(),b->size()); i++)
+                ready_pos[i]=b->get(i).asFloat64();
+
+        // log the replies of the object retriever
+        // to be fed back by assignment_grasp-it-replay
+        if (rf.check("record"))
+            if (!object.record(rf.find("record").asString()))
+                return false;
+
+        if (!object.open(prefix))
+        {
+            yError()<<"Unable to open the object retriever ports";
+            return false;
+        }
+
+        // we can take care of the connections on our own
+        // to select the carrier (e.g. shmem on the same host)
+        if (rf.check("location-remote") || rf.check("calibration-remote"))
+            if (!object.connect(rf.check("location-remote",Value("")).asString(),
+                                rf.check("calibration-remote",Value("")).asString(),
+                                rf.check("carrier",Value("tcp")).asString()))
+                return false;
 
-        rpcPort.open("/service");
+        if (!replay && !openDevices(robot))
+            return false;
+
+        rpcPort.open(prefix+"/service");
         attach(rpcPort);
+
+        // the replay drives the recorded requests through here
+        object.logConnection("service",rpcPort.getName());
         return true;
     }
 
@@ -285,13 +658,16 @@ public:
     /***************************************************/
     bool close()
     {
-        drvArmR.view(iarm);
-        iarm->restoreContext(startup_ctxt_arm_right);
+        if (!replay)
+        {
+            drvArmR.view(iarm);
+            iarm->restoreContext(startup_ctxt_arm_right);
 
-        drvArmL.view(iarm);
-        iarm->restoreContext(startup_ctxt_arm_left);
+            drvArmL.view(iarm);
+            iarm->restoreContext(startup_ctxt_arm_left);
 
-        igaze->restoreContext(startup_ctxt_gaze);
+            igaze->restoreContext(startup_ctxt_gaze);
+        }
 
         drvArmR.close();
         drvArmL.close();
@@ -312,6 +688,10 @@ public:
             reply.addString("Available commands:");
             reply.addString("- look_down");
             reply.addString("- grasp_it");
+            reply.addString("- release");
+            reply.addString("- grasp_next");
+            reply.addString("- home");
+            reply.addString("- servo_report");
             reply.addString("- quit");
         }
         else if (cmd=="look_down")
@@ -321,19 +701,54 @@ public:
             reply.addString("ack");
             reply.addString("Yep! I'm looking down now!");
         }
-        else if (cmd=="grasp_it")
+        else if (cmd=="home")
+        {
+            home();
+            reply.addString("ack");
+            reply.addString("I'm back home!");
+        }
+        else if (cmd=="servo_report")
+        {
+            reply.addString(servo_report.empty()?"nack":"ack");
+            reply.addString(servo_report);
+        }
+        else if (cmd=="release")
+        {
+            // the reply is asynchronous: the arm is still heading
+            // to the ready pose and its next motion will wait for it
+            if (release())
+            {
+                reply.addString("ack");
+                reply.addString("Here you are!");
+            }
+            else
+            {
+                reply.addString("nack");
+                reply.addString("I'm not holding anything!");
+            }
+        }
+        else if ((cmd=="grasp_it") || (cmd=="grasp_next"))
         {
             // the "closure" accounts for how much we should
             // close the fingers around the object:
             // if closure == 0.0, the finger joints have to reach their minimum
             // if closure == 1.0, the finger joints have to reach their maximum
-            double fingers_closure=0.0; // default value
+            double fingers_closure=default_closure;
 
             // we can pass a new value via rpc
             if (command.size()>1)
                 fingers_closure=command.get(1).asFloat64();
 
-            bool ok=grasp_it(fingers_closure);
+            // with "grasp_next", we first drop what we are holding
+            // and localize the next object on the way back; then,
+            // the arm gets staged above this coarse location
+            // while the location is being refined
+            bool staged=(cmd=="grasp_next");
+            Vector location;
+            if (staged)
+                release(&location);
+
+            bool ok=grasp_it(fingers_closure,staged,location);
             // we assume the robot is not moving now
             if (ok)
             {
@@ -343,12 +758,16 @@ public:
             else
             {
                 reply.addString("nack");
-                reply.addString("I don't see any object!");
+                reply.addString(missed?"I couldn't grasp the object!":"I don't see any object!");
             }
         }
         else
             // the father class already handles the "quit" command
             return RFModule::respond(command,reply);
+
+        // log the requests so that the replay can drive them again
+        if (cmd!="help")
+            object.logQuery("service",command,reply);
         return true;
     }
 
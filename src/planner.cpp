@@ -0,0 +1,228 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <yarp/os/Value.h>
+#include <yarp/os/Bottle.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/sig/Matrix.h>
+#include <yarp/math/Math.h>
+#include "planner.h"
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::dev;
+using namespace yarp::math;
+
+
+/***************************************************/
+static vector<double> getList(const Property &options, const string &key,
+                              const vector<double> &def)
+{
+    if (Bottle *b=options.find(key).asList())
+    {
+        vector<double> list;
+        for (size_t i=0; i<b->size(); i++)
+            list.push_back(b->get(i).asFloat64());
+        return list;
+    }
+    return def;
+}
+
+/***************************************************/
+GraspPlanner::GraspPlanner(ICartesianControl *iarmR,
+                           ICartesianControl *iarmL,
+                           const double via_height,
+                           const Property &options)
+{
+    armR.iarm=iarmR;
+    armL.iarm=iarmL;
+
+    // rotations [deg] applied to the nominal orientation
+    // about the z-axis and the y-axis of the root frame
+    yaws=getList(options,"yaws",{-30.0,-15.0,0.0,15.0,30.0});
+    tilts=getList(options,"tilts",{-10.0,0.0,10.0});
+    via_heights=getList(options,"via-heights",{via_height,2.0*via_height});
+
+    // the solver of each arm serves one request at a time,
+    // hence there is no use in more workers than arms
+    threads=options.check("threads",Value(2)).asInt32();
+    prune_residual=options.check("prune-residual",Value(0.02)).asFloat64();
+    joint_speed=options.check("joint-speed",Value(20.0)).asFloat64();
+    w_residual=options.check("w-residual",Value(100.0)).asFloat64();
+    w_margin=options.check("w-margin",Value(1.0)).asFloat64();
+    w_time=options.check("w-time",Value(0.2)).asFloat64();
+}
+
+/***************************************************/
+bool GraspPlanner::prepare(Arm &arm)
+{
+    // the starting configuration along with the joints bounds
+    Vector xdhat,odhat;
+    if (!arm.iarm->getDesired(xdhat,odhat,arm.q0))
+        return false;
+
+    arm.qmin.resize(arm.q0.length());
+    arm.qmax.resize(arm.q0.length());
+    for (int i=0; i<(int)arm.q0.length(); i++)
+        if (!arm.iarm->getLimits(i,&arm.qmin[i],&arm.qmax[i]))
+            return false;
+
+    return true;
+}
+
+/***************************************************/
+double GraspPlanner::askForPose(Arm &arm, const Vector &q0,
+                                const Vector &xd, const Vector &od,
+                                Vector &qd)
+{
+    Vector xdhat,odhat;
+    {
+        // the solver serves one request at a time for each arm
+        lock_guard<mutex> lck(arm.mtx);
+        if (!arm.iarm->askForPose(q0,xd,od,xdhat,odhat,qd))
+            return numeric_limits<double>::infinity();
+    }
+
+    // orientation errors get weighted as 1 rad ~ 10 cm
+    Matrix R=axis2dcm(od)*axis2dcm(odhat).transposed();
+    return norm(xd-xdhat)+0.1*fabs(dcm2axis(R)[3]);
+}
+
+/***************************************************/
+void GraspPlanner::evaluate(const Vector &x, GraspCandidate &c)
+{
+    Arm &arm=(c.hand=="right"?armR:armL);
+
+    Vector xa=x;
+    xa[2]+=c.via_height;
+
+    // solve for the via-point first, then for the target
+    // starting off from the via-point configuration
+    Vector qa,qd;
+    double ra=askForPose(arm,arm.q0,xa,c.o,qa);
+    c.residual=ra;
+
+    // a via-point out of reach is not worth a second solve
+    if (!std::isfinite(ra) || (ra>prune_residual))
+    {
+        c.score=numeric_limits<double>::infinity();
+        return;
+    }
+
+    double rd=askForPose(arm,qa,x,c.o,qd);
+    c.residual=std::max(ra,rd);
+    if (!std::isfinite(c.residual))
+    {
+        c.score=numeric_limits<double>::infinity();
+        return;
+    }
+
+    // normalized distance from the closest joint bound
+    c.margin=1.0;
+    for (size_t i=0; i<qd.length(); i++)
+    {
+        double range=arm.qmax[i]-arm.qmin[i];
+        if (range>0.0)
+        {
+            c.margin=std::min(c.margin,std::min(qa[i]-arm.qmin[i],arm.qmax[i]-qa[i])/range);
+            c.margin=std::min(c.margin,std::min(qd[i]-arm.qmin[i],arm.qmax[i]-qd[i])/range);
+        }
+    }
+
+    // the slowest joint drives the motion time
+    double dq=0.0;
+    for (size_t i=0; i<qd.length(); i++)
+        dq=std::max(dq,fabs(qa[i]-arm.q0[i])+fabs(qd[i]-qa[i]));
+    c.time=dq/joint_speed;
+
+    c.score=w_residual*c.residual-w_margin*c.margin+w_time*c.time;
+}
+
+/***************************************************/
+bool GraspPlanner::plan(const Vector &x, const Vector &oR,
+                        const Vector &oL, GraspCandidate &best)
+{
+    bool okR=prepare(armR);
+    bool okL=prepare(armL);
+
+    // each arm has its own list of candidates
+    vector<GraspCandidate> candidates[2];
+    for (int h=0; h<2; h++)
+    {
+        if ((h==0)?!okR:!okL)
+            continue;
+
+        Matrix R0=axis2dcm((h==0)?oR:oL);
+        for (auto &yaw:yaws)
+        {
+            for (auto &tilt:tilts)
+            {
+                Vector rz(4,0.0),ry(4,0.0);
+                rz[2]=1.0; rz[3]=yaw*M_PI/180.0;
+                ry[1]=1.0; ry[3]=tilt*M_PI/180.0;
+                Vector o=dcm2axis(axis2dcm(rz)*axis2dcm(ry)*R0);
+                for (auto &via_height:via_heights)
+                {
+                    GraspCandidate c;
+                    c.hand=(h==0?"right":"left");
+                    c.o=o;
+                    c.via_height=via_height;
+                    c.residual=c.margin=c.time=0.0;
+                    candidates[h].push_back(c);
+                }
+            }
+        }
+    }
+
+    if (candidates[0].empty() && candidates[1].empty())
+    {
+        yError()<<"No arm available for planning";
+        return false;
+    }
+
+    // workers are spread across the arms, so that both solvers
+    // run at the same time; whoever is done with its own arm
+    // then helps out with the other one
+    atomic<size_t> next[2];
+    next[0]=next[1]=0;
+    auto worker=[&](const int h) {
+        for (int k=0; k<2; k++)
+        {
+            vector<GraspCandidate> &list=candidates[(h+k)%2];
+            atomic<size_t> &cur=next[(h+k)%2];
+            for (size_t i=cur++; i<list.size(); i=cur++)
+                evaluate(x,list[i]);
+        }
+    };
+
+    vector<thread> pool;
+    int n=std::max(1,std::min(threads,(int)(candidates[0].size()+candidates[1].size())));
+    for (int i=0; i<n; i++)
+        pool.push_back(thread(worker,i%2));
+    for (auto &t:pool)
+        t.join();
+
+    auto cmp=[](const GraspCandidate &a, const GraspCandidate &b) {
+        return a.score<b.score;
+    };
+    candidates[0].insert(candidates[0].end(),candidates[1].begin(),candidates[1].end());
+    auto it=min_element(candidates[0].begin(),candidates[0].end(),cmp);
+    if (!std::isfinite(it->score))
+    {
+        yError()<<"No feasible candidate found";
+        return false;
+    }
+
+    best=*it;
+    yInfo()<<"planned over"<<candidates[0].size()<<"candidates: hand ="<<best.hand
+           <<"residual ="<<best.residual<<"[m], margin ="<<best.margin
+           <<", time ="<<best.time<<"[s]";
+    return true;
+}
@@ -0,0 +1,62 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <yarp/os/Property.h>
+#include <yarp/sig/Vector.h>
+#include <yarp/dev/CartesianControl.h>
+
+struct GraspCandidate
+{
+    std::string hand;
+    yarp::sig::Vector o;
+    double via_height;
+    double residual;
+    double margin;
+    double time;
+    double score;
+};
+
+class GraspPlanner
+{
+    struct Arm
+    {
+        yarp::dev::ICartesianControl *iarm;
+        std::mutex mtx;
+        yarp::sig::Vector q0;
+        yarp::sig::Vector qmin;
+        yarp::sig::Vector qmax;
+    } armR, armL;
+
+    std::vector<double> yaws;
+    std::vector<double> tilts;
+    std::vector<double> via_heights;
+    int threads;
+    double prune_residual;
+    double joint_speed;
+    double w_residual;
+    double w_margin;
+    double w_time;
+
+    bool prepare(Arm &arm);
+    double askForPose(Arm &arm, const yarp::sig::Vector &q0,
+                      const yarp::sig::Vector &xd, const yarp::sig::Vector &od,
+                      yarp::sig::Vector &qd);
+    void evaluate(const yarp::sig::Vector &x, GraspCandidate &c);
+
+public:
+    GraspPlanner(yarp::dev::ICartesianControl *iarmR,
+                 yarp::dev::ICartesianControl *iarmL,
+                 const double via_height,
+                 const yarp::os::Property &options);
+    bool plan(const yarp::sig::Vector &x, const yarp::sig::Vector &oR,
+              const yarp::sig::Vector &oL, GraspCandidate &best);
+};
+
+#endif
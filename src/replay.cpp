@@ -0,0 +1,349 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+
+#include <yarp/os/all.h>
+
+using namespace std;
+using namespace yarp::os;
+
+
+/***************************************************/
+struct Entry
+{
+    double stamp;
+    Bottle cmd;
+    Bottle reply;
+};
+
+
+/***************************************************/
+class ReplayModule: public RFModule
+{
+    // one stand-in port for each peer of the object retriever
+    struct Peer
+    {
+        string name;
+        string source;
+        bool linked{false};
+        vector<Entry> entries;
+        size_t cur{0};
+        RpcServer port;
+    };
+
+    /***************************************************/
+    class StandIn: public PortReader
+    {
+        ReplayModule *mod;
+        Peer *peer;
+
+        /***************************************************/
+        bool read(ConnectionReader &connection) override
+        {
+            Bottle cmd,reply;
+            cmd.read(connection);
+            mod->serve(*peer,cmd,reply);
+            if (ConnectionWriter *returnToSender=connection.getWriter())
+                reply.write(*returnToSender);
+            return true;
+        }
+
+    public:
+        /***************************************************/
+        StandIn(ReplayModule *mod_, Peer *peer_) : mod(mod_), peer(peer_) { }
+    };
+
+    mutex mtx;
+    map<string,Peer> peers;
+    vector<unique_ptr<StandIn>> standins;
+
+    // the recorded requests to the module's service port
+    string service;
+    vector<Entry> requests;
+    size_t next_request;
+    RpcClient driver;
+    int mismatched;
+
+    double speed;
+    bool loop;
+    double t0_log;
+    double t0_wall;
+    int served;
+    int diverged;
+
+    /***************************************************/
+    bool load(const string &file)
+    {
+        ifstream fin(file.c_str());
+        if (!fin.is_open())
+        {
+            yError()<<"Unable to open \""<<file<<'\"';
+            return false;
+        }
+
+        string str;
+        while (getline(fin,str))
+        {
+            Bottle line(str);
+            if (line.size()<3)
+                continue;
+
+            double stamp=line.get(0).asFloat64();
+            string tag=line.get(1).asString();
+            if (tag=="connect")
+            {
+                string peer=line.get(2).asString();
+                if (peer=="service")
+                    service=line.get(3).asString();
+                else
+                {
+                    peers[peer].name=line.get(3).asString();
+                    peers[peer].source=line.get(4).asString();
+                }
+            }
+            else if (Bottle *cmd=line.get(2).asList())
+            {
+                Entry entry;
+                entry.stamp=stamp;
+                entry.cmd=*cmd;
+                if (Bottle *reply=line.get(3).asList())
+                    entry.reply=*reply;
+                if (tag=="service")
+                    requests.push_back(entry);
+                else
+                {
+                    peers[tag].entries.push_back(entry);
+                    t0_log=std::min(t0_log,stamp);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /***************************************************/
+    void serve(Peer &peer, const Bottle &cmd, Bottle &reply)
+    {
+        Entry entry;
+        {
+            lock_guard<mutex> lck(mtx);
+            if (peer.cur>=peer.entries.size())
+            {
+                if (!loop || peer.entries.empty())
+                {
+                    reply.addVocab32("nack");
+                    return;
+                }
+                peer.cur=0;
+            }
+
+            entry=peer.entries[peer.cur++];
+            if (t0_wall<0.0)
+                t0_wall=Time::now();
+
+            served++;
+            if (entry.cmd.toString()!=cmd.toString())
+            {
+                yWarning()<<"Replay diverged on"<<peer.name<<": got ("<<cmd.toString()
+                          <<") instead of ("<<entry.cmd.toString()<<")";
+                diverged++;
+            }
+        }
+
+        // by default replies are served at max speed;
+        // otherwise we stick to the recorded timing scaled by speed
+        if (speed>0.0)
+        {
+            double dt=(entry.stamp-t0_log)/speed-(Time::now()-t0_wall);
+            if (dt>0.0)
+                Time::delay(dt);
+        }
+
+        reply=entry.reply;
+    }
+
+    /***************************************************/
+    bool link()
+    {
+        // hook up the module to the stand-ins as soon as
+        // its ports show up, with the recorded connections
+        bool ok=true;
+        for (auto &it:peers)
+        {
+            Peer &peer=it.second;
+            if (!peer.linked && !peer.source.empty() && peer.port.isOpen())
+            {
+                if (Network::exists(peer.source,true))
+                    peer.linked=Network::connect(peer.source,peer.name,"tcp",true);
+                ok&=peer.linked;
+            }
+        }
+        return ok;
+    }
+
+    /***************************************************/
+    void drive()
+    {
+        if (driver.getOutputCount()==0)
+        {
+            if (!Network::exists(service,true) ||
+                !Network::connect(driver.getName(),service,"tcp",true))
+                return;
+            yInfo()<<"Driving"<<requests.size()<<"recorded requests to"<<service;
+        }
+
+        // requests go back to back, while the stand-ins
+        // take care of pacing the replies of the peers
+        const Entry &entry=requests[next_request++];
+        Bottle reply;
+        if (!driver.write(entry.cmd,reply))
+        {
+            yError()<<"Unable to send ("<<entry.cmd.toString()<<") to"<<service;
+            return;
+        }
+
+        // the first item of the reply tells the outcome
+        // of the control logic (e.g. ack/nack)
+        if (reply.get(0).toString()!=entry.reply.get(0).toString())
+        {
+            yWarning()<<"Replay diverged on ("<<entry.cmd.toString()<<"): got ("
+                      <<reply.toString()<<") instead of ("<<entry.reply.toString()<<")";
+            mismatched++;
+        }
+        else
+            yInfo()<<"("<<entry.cmd.toString()<<") => ("<<reply.toString()<<")";
+    }
+
+public:
+    /***************************************************/
+    bool configure(ResourceFinder &rf)
+    {
+        if (!rf.check("file"))
+        {
+            yError()<<"Please provide the recording via --file";
+            return false;
+        }
+
+        speed=rf.check("speed",Value(0.0)).asFloat64();
+        loop=rf.check("loop");
+        t0_log=std::numeric_limits<double>::max();
+        t0_wall=-1.0;
+        served=diverged=mismatched=0;
+        next_request=0;
+
+        if (!load(rf.find("file").asString()))
+            return false;
+
+        for (auto &it:peers)
+        {
+            Peer &peer=it.second;
+
+            // the recorded peer names can be overridden
+            // so that we don't clash with live components
+            peer.name=rf.check(it.first,Value(peer.name)).asString();
+            if (peer.name.empty())
+            {
+                yWarning()<<"Skipping"<<it.first<<": no port name available";
+                continue;
+            }
+
+            standins.push_back(unique_ptr<StandIn>(new StandIn(this,&peer)));
+            peer.port.setReader(*standins.back());
+            if (!peer.port.open(peer.name))
+            {
+                close();
+                return false;
+            }
+
+            yInfo()<<"Standing in for"<<peer.name<<"with"
+                   <<peer.entries.size()<<"recorded replies";
+        }
+
+        // with the module running in replay mode, we also drive
+        // the recorded requests; otherwise, we just stand in
+        service=rf.check("service",Value(service)).asString();
+        if (!requests.empty() && !service.empty())
+        {
+            string name=rf.check("name",Value("/assignment_grasp-it-replay")).asString();
+            if (!driver.open(name+"/service"))
+            {
+                close();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /***************************************************/
+    bool close()
+    {
+        for (auto &it:peers)
+            if (it.second.port.isOpen())
+                it.second.port.close();
+        driver.close();
+        return true;
+    }
+
+    /***************************************************/
+    double getPeriod()
+    {
+        return 0.1;
+    }
+
+    /***************************************************/
+    bool updateModule()
+    {
+        if (link() && driver.isOpen() && (next_request<requests.size()))
+        {
+            drive();
+            return true;
+        }
+
+        lock_guard<mutex> lck(mtx);
+        bool done=!loop;
+        if (driver.isOpen())
+            done=(next_request>=requests.size());
+        else
+            for (auto &it:peers)
+                done&=(it.second.cur>=it.second.entries.size());
+
+        if (done)
+        {
+            yInfo()<<"Replay over: served"<<served<<"replies,"<<diverged<<"diverged";
+            if (driver.isOpen())
+                yInfo()<<"Driven"<<next_request<<"requests,"<<mismatched<<"with a different outcome";
+            if (t0_wall>0.0)
+                yInfo()<<"Elapsed wall time ="<<Time::now()-t0_wall<<"[s]";
+            return false;
+        }
+
+        return true;
+    }
+};
+
+
+/***************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    if (!yarp.checkNetwork())
+    {
+        yError()<<"YARP doesn't seem to be available";
+        return 1;
+    }
+
+    ReplayModule mod;
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+    return mod.runModule(rf);
+}
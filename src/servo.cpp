@@ -0,0 +1,200 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <yarp/os/Time.h>
+#include <yarp/os/Value.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/sig/Matrix.h>
+#include <yarp/math/Math.h>
+#include "servo.h"
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::dev;
+using namespace yarp::math;
+
+
+/***************************************************/
+LocationTracker::LocationTracker(ObjectRetriever &object,
+                                 const string &hand,
+                                 const double period) :
+                                 object(object), hand(hand),
+                                 period(period), stamp(-1.0)
+{
+}
+
+/***************************************************/
+void LocationTracker::run()
+{
+    // the localization runs at its own pace, so that
+    // its latency does not affect the control loop
+    int failures=0;
+    double t_report=Time::now();
+    while (!isStopping())
+    {
+        double t=Time::now();
+        Vector x;
+        if (object.trackLocation(x,hand))
+        {
+            lock_guard<mutex> lck(mtx);
+            location=x;
+            stamp=t;
+        }
+        else
+            failures++;
+
+        // report failures once per second at most
+        if ((failures>0) && (t-t_report>=1.0))
+        {
+            yWarning()<<"Unable to track location"<<failures<<"time(s) in the last"
+                      <<t-t_report<<"[s]";
+            failures=0;
+            t_report=t;
+        }
+
+        // no point in querying faster than the localization
+        Time::delay(std::max(0.0,period-(Time::now()-t)));
+    }
+}
+
+/***************************************************/
+bool LocationTracker::getLatest(Vector &location, double &stamp)
+{
+    lock_guard<mutex> lck(mtx);
+    if (this->stamp<0.0)
+        return false;
+
+    location=this->location;
+    stamp=this->stamp;
+    return true;
+}
+
+/***************************************************/
+ServoThread::ServoThread(const double period, ICartesianControl *iarm,
+                         ObjectRetriever &object, const string &hand,
+                         const Vector &od, const Property &options) :
+                         PeriodicThread(period), iarm(iarm),
+                         tracker(object,hand,options.check("tracker-period",Value(0.1)).asFloat64()),
+                         od(od), done(false), reached(false)
+{
+    gain=options.check("gain",Value(3.0)).asFloat64();
+    max_speed=options.check("max-speed",Value(0.1)).asFloat64();
+    tolerance=options.check("tolerance",Value(0.005)).asFloat64();
+    timeout=options.check("timeout",Value(5.0)).asFloat64();
+}
+
+/***************************************************/
+bool ServoThread::threadInit()
+{
+    t0=t_last=Time::now();
+    ticks=0;
+    jitter_sum=jitter_sum2=jitter_max=0.0;
+    return tracker.start();
+}
+
+/***************************************************/
+void ServoThread::run()
+{
+    double t=Time::now();
+    if (ticks>0)
+    {
+        double jitter=fabs((t-t_last)-getPeriod());
+        lock_guard<mutex> lck(mtx);
+        jitter_sum+=jitter;
+        jitter_sum2+=jitter*jitter;
+        jitter_max=std::max(jitter_max,jitter);
+    }
+    t_last=t;
+    ticks++;
+
+    {
+        lock_guard<mutex> lck(mtx);
+        if (done)
+            return;
+    }
+
+    // without any estimate within the timeout, we give up
+    Vector xd; double stamp;
+    if (!tracker.getLatest(xd,stamp))
+    {
+        if (t-t0>timeout)
+        {
+            iarm->stopControl();
+            lock_guard<mutex> lck(mtx);
+            reached=false;
+            done=true;
+        }
+        return;
+    }
+
+    Vector x,o;
+    iarm->getPose(x,o);
+
+    Vector e=xd-x;
+    double dist=norm(e);
+    bool stop_now=(dist<tolerance) || (t-t0>timeout);
+    if (stop_now)
+    {
+        iarm->stopControl();
+        lock_guard<mutex> lck(mtx);
+        reached=(dist<tolerance);
+        done=true;
+        return;
+    }
+
+    // proportional law on the position, saturated in speed
+    Vector v=gain*e;
+    double speed=norm(v);
+    if (speed>max_speed)
+        v*=max_speed/speed;
+
+    // keep the orientation at od
+    Matrix R=axis2dcm(od)*axis2dcm(o).transposed();
+    Vector w=dcm2axis(R);
+    w[3]*=gain;
+
+    iarm->setTaskVelocities(v,w);
+}
+
+/***************************************************/
+void ServoThread::threadRelease()
+{
+    tracker.stop();
+    iarm->stopControl();
+}
+
+/***************************************************/
+bool ServoThread::isDone()
+{
+    lock_guard<mutex> lck(mtx);
+    return done;
+}
+
+/***************************************************/
+bool ServoThread::hasReached()
+{
+    lock_guard<mutex> lck(mtx);
+    return reached;
+}
+
+/***************************************************/
+string ServoThread::report()
+{
+    lock_guard<mutex> lck(mtx);
+    int n=std::max(1,ticks-1);
+    double mean=jitter_sum/n;
+    double stdev=sqrt(std::max(0.0,jitter_sum2/n-mean*mean));
+
+    ostringstream str;
+    str<<"servo "<<(reached?"reached":"missed")<<" the target in "
+       <<t_last-t0<<" [s] over "<<ticks<<" ticks at "<<1.0/getPeriod()
+       <<" [Hz]; jitter: mean = "<<1e3*mean<<" [ms], std = "<<1e3*stdev
+       <<" [ms], max = "<<1e3*jitter_max<<" [ms]";
+    return str.str();
+}
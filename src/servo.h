@@ -0,0 +1,66 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#ifndef SERVO_H
+#define SERVO_H
+
+#include <string>
+#include <mutex>
+#include <yarp/os/Property.h>
+#include <yarp/os/Thread.h>
+#include <yarp/os/PeriodicThread.h>
+#include <yarp/sig/Vector.h>
+#include <yarp/dev/CartesianControl.h>
+#include "helpers.h"
+
+class LocationTracker : public yarp::os::Thread
+{
+    ObjectRetriever &object;
+    std::string hand;
+    double period;
+    std::mutex mtx;
+    yarp::sig::Vector location;
+    double stamp;
+    void run() override;
+
+public:
+    LocationTracker(ObjectRetriever &object, const std::string &hand,
+                    const double period);
+    bool getLatest(yarp::sig::Vector &location, double &stamp);
+};
+
+class ServoThread : public yarp::os::PeriodicThread
+{
+    yarp::dev::ICartesianControl *iarm;
+    LocationTracker tracker;
+    yarp::sig::Vector od;
+    double gain;
+    double max_speed;
+    double tolerance;
+    double timeout;
+
+    std::mutex mtx;
+    bool done;
+    bool reached;
+    double t0;
+    double t_last;
+    int ticks;
+    double jitter_sum;
+    double jitter_sum2;
+    double jitter_max;
+
+    bool threadInit() override;
+    void run() override;
+    void threadRelease() override;
+
+public:
+    ServoThread(const double period, yarp::dev::ICartesianControl *iarm,
+                ObjectRetriever &object, const std::string &hand,
+                const yarp::sig::Vector &od, const yarp::os::Property &options);
+    bool isDone();
+    bool hasReached();
+    std::string report();
+};
+
+#endif
@@ -0,0 +1,303 @@
+// -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*-
+//
+// Author: Ugo Pattacini - <ugo.pattacini@iit.it>
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/os/Os.h>
+
+using namespace std;
+using namespace yarp::os;
+
+
+/***************************************************/
+struct Param
+{
+    string name;
+    double min;
+    double max;
+    double init;
+};
+
+
+/***************************************************/
+struct Candidate
+{
+    vector<double> x;   // normalized in [0,1]
+    double success;
+    double cycle;
+    double fitness;
+};
+
+
+/***************************************************/
+class Tuner
+{
+    vector<Param> params;
+
+    string sweep;
+    string out_dir;
+    int workers;
+    int trials;
+    int seed;
+    double time_weight;
+
+    vector<Candidate> history;
+
+    /***************************************************/
+    double denormalize(const Param &p, const double x) const
+    {
+        return p.min+x*(p.max-p.min);
+    }
+
+    /***************************************************/
+    string toArgs(const vector<double> &x) const
+    {
+        ostringstream str;
+        for (size_t i=0; i<params.size(); i++)
+            str<<(i>0?" ":"")<<"--"<<params[i].name<<" "<<denormalize(params[i],x[i]);
+        return str.str();
+    }
+
+    /***************************************************/
+    bool evaluate(Candidate &c, const string &tag)
+    {
+        string dir=out_dir+"/"+tag;
+
+        // all candidates are exposed to the same ball placements
+        ostringstream cmd;
+        cmd<<sweep<<" --workers "<<workers<<" --trials "<<trials
+           <<" --seed "<<seed<<" --out "<<dir
+           <<" --module-args \""<<toArgs(c.x)<<"\" > "<<dir<<".log 2>&1";
+        yInfo()<<"Evaluating"<<tag<<":"<<toArgs(c.x);
+        if (system(cmd.str().c_str())!=0)
+            yWarning()<<"The sweep of"<<tag<<"reported failures";
+
+        ifstream fin((dir+"/results.csv").c_str());
+        if (!fin.is_open())
+        {
+            yError()<<"Unable to retrieve the results of"<<tag;
+            return false;
+        }
+
+        // worker,trial,result,dx,dy,t_look_down,t_grasp_it,dz,d_min
+        string line;
+        getline(fin,line);
+        int n=0,ok=0,timed=0;
+        double t=0.0;
+        while (getline(fin,line))
+        {
+            vector<string> fields;
+            istringstream tokens(line);
+            string field;
+            while (getline(tokens,field,','))
+                fields.push_back(field);
+            if (fields.size()<7)
+                continue;
+
+            n++;
+            if (fields[2]=="success")
+                ok++;
+            if (fields[2]!="error")
+            {
+                t+=atof(fields[6].c_str());
+                timed++;
+            }
+        }
+
+        if (n==0)
+        {
+            yError()<<"No trials completed for"<<tag;
+            return false;
+        }
+
+        c.success=(double)ok/n;
+        c.cycle=(timed>0?t/timed:0.0);
+        c.fitness=c.success-time_weight*c.cycle;
+        yInfo()<<tag<<": success rate ="<<c.success<<", cycle time ="<<c.cycle<<"[s]";
+        history.push_back(c);
+        return true;
+    }
+
+    /***************************************************/
+    void report() const
+    {
+        ofstream fout((out_dir+"/tuner.csv").c_str());
+        fout<<"success,cycle,pareto";
+        for (auto &p:params)
+            fout<<","<<p.name;
+        fout<<endl;
+
+        yInfo()<<"Pareto front (success rate vs. cycle time):";
+        for (auto &c:history)
+        {
+            bool dominated=false;
+            for (auto &d:history)
+            {
+                if ((d.success>=c.success) && (d.cycle<=c.cycle) &&
+                    ((d.success>c.success) || (d.cycle<c.cycle)))
+                {
+                    dominated=true;
+                    break;
+                }
+            }
+
+            fout<<c.success<<","<<c.cycle<<","<<(dominated?0:1);
+            for (size_t i=0; i<params.size(); i++)
+                fout<<","<<denormalize(params[i],c.x[i]);
+            fout<<endl;
+
+            if (!dominated)
+                yInfo()<<"  success rate ="<<c.success<<", cycle time ="<<c.cycle
+                       <<"[s] with"<<toArgs(c.x);
+        }
+    }
+
+public:
+    /***************************************************/
+    Tuner(ResourceFinder &rf)
+    {
+        // via-height and tilt are read only by the parts of the
+        // module left to be filled in (besides staging and planning),
+        // so they are searched only upon request
+        if (rf.check("geometry"))
+        {
+            params.push_back({"via-height",0.02,0.10,0.05});
+            params.push_back({"tilt",0.0,45.0,30.0});
+        }
+
+        // the grasp parameters exposed by the module
+        params.push_back({"pre-shape-abduction",0.0,1.0,0.7});
+        params.push_back({"pre-shape-thumb",0.0,1.0,1.0});
+        params.push_back({"pre-shape-fingers",0.0,0.5,0.0});
+        params.push_back({"closure",0.0,1.0,0.0});
+        params.push_back({"margin",0.0,0.08,0.05});
+
+        sweep=rf.check("sweep",Value("./sweep/sweep.sh")).asString();
+        out_dir=rf.check("out",Value("tuner-results")).asString();
+        workers=rf.check("workers",Value(4)).asInt32();
+        trials=rf.check("trials",Value(20)).asInt32();
+        seed=rf.check("seed",Value(0)).asInt32();
+        time_weight=rf.check("time-weight",Value(0.01)).asFloat64();
+    }
+
+    /***************************************************/
+    // (mu/mu_w,lambda)-ES with cumulative step-size adaptation,
+    // operating on the parameters normalized within their bounds
+    void run(const int generations, const int lambda, double sigma)
+    {
+        const size_t n=params.size();
+        const int mu=std::max(1,lambda/2);
+
+        vector<double> w(mu);
+        double sw=0.0,sw2=0.0;
+        for (int i=0; i<mu; i++)
+        {
+            w[i]=log(mu+0.5)-log(i+1.0);
+            sw+=w[i];
+        }
+        for (auto &wi:w)
+        {
+            wi/=sw;
+            sw2+=wi*wi;
+        }
+
+        const double mueff=1.0/sw2;
+        const double cs=(mueff+2.0)/(n+mueff+5.0);
+        const double ds=1.0+2.0*std::max(0.0,sqrt((mueff-1.0)/(n+1.0))-1.0)+cs;
+        const double chiN=sqrt((double)n)*(1.0-1.0/(4.0*n)+1.0/(21.0*n*n));
+
+        yarp::os::mkdir_p(out_dir.c_str());
+
+        vector<double> m(n),ps(n,0.0);
+        for (size_t i=0; i<n; i++)
+            m[i]=(params[i].init-params[i].min)/(params[i].max-params[i].min);
+
+        Candidate c0{m,0.0,0.0,0.0};
+        evaluate(c0,"initial");
+
+        mt19937 gen(seed);
+        normal_distribution<double> N(0.0,1.0);
+        for (int g=0; g<generations; g++)
+        {
+            vector<Candidate> pop;
+            for (int k=0; k<lambda; k++)
+            {
+                Candidate c{vector<double>(n),0.0,0.0,0.0};
+                for (size_t i=0; i<n; i++)
+                    c.x[i]=std::min(1.0,std::max(0.0,m[i]+sigma*N(gen)));
+
+                ostringstream tag;
+                tag<<"gen"<<g<<"-cand"<<k;
+                if (evaluate(c,tag.str()))
+                    pop.push_back(c);
+            }
+
+            if ((int)pop.size()<mu)
+            {
+                yWarning()<<"Too few candidates survived generation"<<g;
+                continue;
+            }
+
+            sort(pop.begin(),pop.end(),[](const Candidate &a, const Candidate &b) {
+                return a.fitness>b.fitness;
+            });
+
+            vector<double> m_old=m;
+            fill(m.begin(),m.end(),0.0);
+            for (int k=0; k<mu; k++)
+                for (size_t i=0; i<n; i++)
+                    m[i]+=w[k]*pop[k].x[i];
+
+            double norm_ps=0.0;
+            for (size_t i=0; i<n; i++)
+            {
+                ps[i]=(1.0-cs)*ps[i]+sqrt(cs*(2.0-cs)*mueff)*(m[i]-m_old[i])/sigma;
+                norm_ps+=ps[i]*ps[i];
+            }
+            sigma*=exp((cs/ds)*(sqrt(norm_ps)/chiN-1.0));
+
+            yInfo()<<"Generation"<<g<<": best fitness ="<<pop[0].fitness<<", sigma ="<<sigma;
+        }
+
+        report();
+    }
+};
+
+
+/***************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        yInfo()<<"Options:";
+        yInfo()<<"--sweep <script>     path to sweep.sh (default = ./sweep/sweep.sh)";
+        yInfo()<<"--out <dir>          where results are stored (default = tuner-results)";
+        yInfo()<<"--workers <n>        parallel worlds per evaluation (default = 4)";
+        yInfo()<<"--trials <n>         trials per candidate (default = 20)";
+        yInfo()<<"--seed <n>           seed of ball placements and sampling (default = 0)";
+        yInfo()<<"--population <n>     candidates per generation (default = 8)";
+        yInfo()<<"--generations <n>    number of generations (default = 10)";
+        yInfo()<<"--sigma <s>          initial normalized step-size (default = 0.2)";
+        yInfo()<<"--time-weight <w>    fitness = success rate - w * cycle time (default = 0.01)";
+        yInfo()<<"--geometry           search also via-height and tilt";
+        return 0;
+    }
+
+    Tuner tuner(rf);
+    tuner.run(rf.check("generations",Value(10)).asInt32(),
+              rf.check("population",Value(8)).asInt32(),
+              rf.check("sigma",Value(0.2)).asFloat64());
+    return 0;
+}
@@ -5,11 +5,20 @@
 #include <functional>
 #include <mutex>
 #include <string>
+#include <set>
+#include <array>
+#include <chrono>
+#include <algorithm>
 #include <cmath>
 
 #include <gazebo/common/Plugin.hh>
 #include <gazebo/physics/World.hh>
 #include <gazebo/physics/Model.hh>
+#include <gazebo/physics/PhysicsEngine.hh>
+#include <gazebo/physics/ContactManager.hh>
+#include <gazebo/physics/Contact.hh>
+#include <gazebo/physics/Collision.hh>
+#include <gazebo/physics/Link.hh>
 #include <gazebo/common/Events.hh>
 #include <ignition/math/Pose3.hh>
 
@@ -17,23 +26,102 @@
 #include <yarp/os/ConnectionWriter.h>
 #include <yarp/os/PortReader.h>
 #include <yarp/os/Port.h>
+#include <yarp/os/BufferedPort.h>
 #include <yarp/os/Bottle.h>
 #include <yarp/os/Vocab.h>
 
 namespace gazebo {
 
+/******************************************************************************/
+class Histogram
+{
+    // bin i collects durations in [2^(i-1), 2^i) us
+    std::array<int, 20> bins;
+    int count;
+    double sum;
+    double max;
+
+public:
+    /**************************************************************************/
+    Histogram() { reset(); }
+
+    /**************************************************************************/
+    void reset() {
+        bins.fill(0);
+        count = 0;
+        sum = max = 0.0;
+    }
+
+    /**************************************************************************/
+    void add(const double dt) {
+        const auto us = dt * 1e6;
+        const auto i = (us < 1.0) ? 0 : 1 + static_cast<int>(std::log2(us));
+        bins[std::min(i, static_cast<int>(bins.size()) - 1)]++;
+        sum += dt;
+        max = std::max(max, dt);
+        count++;
+    }
+
+    /**************************************************************************/
+    void toBottle(const std::string& name, yarp::os::Bottle& b) const {
+        auto& l = b.addList();
+        l.addString(name);
+        l.addFloat64(count > 0 ? sum / count : 0.0);
+        l.addFloat64(max);
+        auto& h = l.addList();
+        for (const auto& n : bins) {
+            h.addInt32(n);
+        }
+    }
+};
+
 /******************************************************************************/
 class WorldHandler : public gazebo::WorldPlugin
 {
     gazebo::physics::WorldPtr world;
     gazebo::physics::ModelPtr ball;
     gazebo::event::ConnectionPtr renderer_connection;
+    gazebo::event::ConnectionPtr renderer_end_connection;
+
+    // profiling of the physics step
+    using clock = std::chrono::steady_clock;
+    bool telemetry{true};
+    double telemetry_period{1.0};
+    clock::time_point step_begin;
+    clock::time_point window_begin;
+    double window_sim_begin{0.0};
+    int window_steps{0};
+    Histogram step_time;
+    Histogram critical_time;
+    double contacts_sum{0.0};
+    unsigned int contacts_max{0};
+    yarp::os::BufferedPort<yarp::os::Bottle> telemetryPort;
 
     std::mutex mtx;
     bool set_new_pose{false};
     ignition::math::Pose3d cur_pose;
     ignition::math::Pose3d new_pose;
 
+    // contacts between the ball and the hands
+    bool grasp_tracking{true};
+    struct GraspState {
+        bool contact{false};
+        int fingers{0};
+        bool slipping{false};
+        double lifted{0.0};
+    } grasp_state;
+    double rest_height{0.0};
+    double slip_threshold{0.02};
+    yarp::os::BufferedPort<yarp::os::Bottle> graspPort;
+
+    /**************************************************************************/
+    static void fillGraspState(const GraspState& state, yarp::os::Bottle& b) {
+        b.addInt32(state.contact ? 1 : 0);
+        b.addInt32(state.fingers);
+        b.addInt32(state.slipping ? 1 : 0);
+        b.addFloat64(state.lifted);
+    }
+
     yarp::os::Port rpcPort;
     /**************************************************************************/
     class DataProcessor : public yarp::os::PortReader {
@@ -60,10 +148,15 @@ class WorldHandler : public gazebo::WorldPlugin
                         const auto& q = hdl->cur_pose.Rot();
                         hdl->new_pose = ignition::math::Pose3d(x, y, z, q.W(), q.X(), q.Y(), q.Z());
                         hdl->set_new_pose = true;
+                        hdl->rest_height = z;
                         rep.addVocab32("ack");
                     } else {
                         rep.addVocab32("nack");
                     }
+                } else if ((cmd.get(0).asString() == "grasp_state") && hdl->grasp_tracking) {
+                    // contact fingers slipping lifted
+                    rep.addVocab32("ack");
+                    fillGraspState(hdl->grasp_state, rep);
                 } else {
                     rep.addVocab32("nack");
                 }
@@ -79,12 +172,137 @@ class WorldHandler : public gazebo::WorldPlugin
 
     /**************************************************************************/
     void onWorld() {
-        std::lock_guard<std::mutex> lck(mtx);
-        if (set_new_pose) {
-            ball->SetWorldPose(new_pose);
-            set_new_pose = false;
+        step_begin = clock::now();
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            if (set_new_pose) {
+                ball->SetWorldPose(new_pose);
+                ball->ResetPhysicsStates();
+                set_new_pose = false;
+            }
+            cur_pose = ball->WorldPose();
+        }
+        if (telemetry) {
+            critical_time.add(std::chrono::duration<double>(clock::now() - step_begin).count());
+        }
+    }
+
+    /**************************************************************************/
+    static bool isHandLink(const gazebo::physics::LinkPtr& link) {
+        return (link != nullptr) && (link->GetName().find("hand") != std::string::npos);
+    }
+
+    /**************************************************************************/
+    // a finger spans several links: identify it by the hand
+    // (e.g. "l_" in "l_hand_index_2") along with the finger name
+    static std::string fingerOf(const gazebo::physics::LinkPtr& link) {
+        const auto& name = link->GetName();
+        for (const auto& finger : {"thumb", "index", "middle", "ring", "little"}) {
+            if (name.find(finger) != std::string::npos) {
+                return name.substr(0, name.find("hand")) + finger;
+            }
+        }
+        return "";
+    }
+
+    /**************************************************************************/
+    void trackGrasp() {
+        GraspState state;
+        std::set<std::string> fingers;
+        const auto ball_vel = ball->WorldLinearVel();
+
+        auto manager = world->Physics()->GetContactManager();
+        const auto& contacts = manager->GetContacts();
+        for (unsigned int i = 0; i < manager->GetContactCount(); i++) {
+            const auto* contact = contacts[i];
+            if ((contact->collision1 == nullptr) || (contact->collision2 == nullptr)) {
+                continue;
+            }
+
+            auto link1 = contact->collision1->GetLink();
+            auto link2 = contact->collision2->GetLink();
+            gazebo::physics::LinkPtr hand;
+            if (link1->GetModel() == ball) {
+                hand = link2;
+            } else if (link2->GetModel() == ball) {
+                hand = link1;
+            }
+            if (!isHandLink(hand)) {
+                continue;
+            }
+
+            state.contact = true;
+            const auto finger = fingerOf(hand);
+            if (!finger.empty()) {
+                fingers.insert(finger);
+            }
+            if ((ball_vel - hand->WorldLinearVel()).Length() > slip_threshold) {
+                state.slipping = true;
+            }
+        }
+        state.fingers = static_cast<int>(fingers.size());
+
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            state.lifted = cur_pose.Pos().Z() - rest_height;
+            grasp_state = state;
+        }
+
+        if (graspPort.getOutputCount() > 0) {
+            auto& b = graspPort.prepare();
+            b.clear();
+            fillGraspState(state, b);
+            graspPort.write();
+        }
+    }
+
+    /**************************************************************************/
+    void profileStep() {
+        const auto now = clock::now();
+        step_time.add(std::chrono::duration<double>(now - step_begin).count());
+
+        const auto contacts = world->Physics()->GetContactManager()->GetContactCount();
+        contacts_sum += contacts;
+        contacts_max = std::max(contacts_max, contacts);
+        window_steps++;
+
+        const auto dt_wall = std::chrono::duration<double>(now - window_begin).count();
+        if (dt_wall >= telemetry_period) {
+            const auto sim_time = world->SimTime().Double();
+            auto& b = telemetryPort.prepare();
+            b.clear();
+            auto& rtf = b.addList();
+            rtf.addString("rtf");
+            rtf.addFloat64((sim_time - window_sim_begin) / dt_wall);
+            auto& steps = b.addList();
+            steps.addString("steps");
+            steps.addInt32(window_steps);
+            step_time.toBottle("step", b);
+            critical_time.toBottle("critical", b);
+            auto& contact = b.addList();
+            contact.addString("contacts");
+            contact.addFloat64(contacts_sum / window_steps);
+            contact.addInt32(static_cast<int>(contacts_max));
+            telemetryPort.write();
+
+            step_time.reset();
+            critical_time.reset();
+            contacts_sum = 0.0;
+            contacts_max = 0;
+            window_steps = 0;
+            window_begin = now;
+            window_sim_begin = sim_time;
+        }
+    }
+
+    /**************************************************************************/
+    void onWorldEnd() {
+        if (telemetry) {
+            profileStep();
+        }
+        if (grasp_tracking) {
+            trackGrasp();
         }
-        cur_pose = ball->WorldPose();
     }
 
 public:
@@ -92,17 +310,58 @@ public:
     WorldHandler() : processor(this) { }
     
     /**************************************************************************/
-    void Load(gazebo::physics::WorldPtr world, sdf::ElementPtr) override {
+    void Load(gazebo::physics::WorldPtr world, sdf::ElementPtr sdf) override {
         std::string ball_name = "assignment_grasp-it-ball";
 
+        // namespace of the ports, to host many worlds on the same name server
+        std::string prefix;
+        if (sdf->HasElement("prefix")) {
+            prefix = sdf->Get<std::string>("prefix");
+        }
+
+        // rolling statistics of the physics step,
+        // published every telemetry_period seconds
+        if (sdf->HasElement("telemetry")) {
+            telemetry = sdf->Get<bool>("telemetry");
+        }
+        if (sdf->HasElement("telemetry_period")) {
+            telemetry_period = sdf->Get<double>("telemetry_period");
+        }
+
         this->world = world;
         ball = world->ModelByName(ball_name);
+        cur_pose = ball->WorldPose();
+        rest_height = cur_pose.Pos().Z();
 
         rpcPort.setReader(processor);
-        rpcPort.open("/" + ball_name + "/rpc");
+        rpcPort.open(prefix + "/" + ball_name + "/rpc");
 
         auto bind = std::bind(&WorldHandler::onWorld, this);
         renderer_connection = gazebo::event::Events::ConnectWorldUpdateBegin(bind);
+
+        if (telemetry) {
+            telemetryPort.open(prefix + "/" + ball_name + "/telemetry:o");
+            window_begin = clock::now();
+            window_sim_begin = world->SimTime().Double();
+        }
+
+        // the state of the grasp is tracked at each step
+        // and streamed to whoever is listening
+        if (sdf->HasElement("grasp_tracking")) {
+            grasp_tracking = sdf->Get<bool>("grasp_tracking");
+        }
+        if (sdf->HasElement("slip_threshold")) {
+            slip_threshold = sdf->Get<double>("slip_threshold");
+        }
+        if (grasp_tracking) {
+            graspPort.open(prefix + "/" + ball_name + "/grasp:o");
+
+            // contacts are dropped otherwise when nobody listens to them
+            world->Physics()->GetContactManager()->SetNeverDropContacts(true);
+        }
+
+        auto bind_end = std::bind(&WorldHandler::onWorldEnd, this);
+        renderer_end_connection = gazebo::event::Events::ConnectWorldUpdateEnd(bind_end);
     }
 
     /**************************************************************************/
@@ -110,6 +369,12 @@ public:
         if (rpcPort.isOpen()) {
             rpcPort.close();
         }
+        if (telemetry) {
+            telemetryPort.close();
+        }
+        if (grasp_tracking) {
+            graspPort.close();
+        }
     }
 };
 
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Copyright: (C) 2026 iCub Facility - Istituto Italiano di Tecnologia
+# Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+# CopyPolicy: Released under the terms of the GNU GPL v3.0.
+
+# Merge the results of the workers and print the summary of the sweep.
+
+if [ $# -lt 1 ] || [ "$1" == "--help" ]; then
+    echo ""
+    echo "Usage: $0 <results-dir>"
+    echo ""
+    exit 0
+fi
+
+out_dir=$1
+merged="$out_dir/results.csv"
+
+echo "worker,trial,result,dx,dy,t_look_down,t_grasp_it,dz,d_min" > "$merged"
+cat "$out_dir"/worker-*/results.csv 2> /dev/null | sort -t, -k2,2n >> "$merged"
+
+awk -F, 'NR>1 {
+    n++;
+    if ($3=="success") {
+        ok++;
+        t+=$7; t2+=$7*$7;
+        if (min=="" || $7<min) min=$7;
+        if ($7>max) max=$7;
+    }
+    else if ($3=="error")
+        err++;
+}
+END {
+    if (n==0) {
+        print "No results available";
+        exit 1;
+    }
+    printf("trials          = %d\n", n);
+    printf("success rate    = %.1f%% (%d/%d)\n", 100.0*ok/n, ok, n);
+    printf("errors          = %d\n", err);
+    if (ok>0) {
+        mean=t/ok;
+        printf("grasp_it time   = %.2f +/- %.2f [s] (min %.2f, max %.2f)\n",
+               mean, sqrt(t2/ok-mean*mean), min, max);
+    }
+}' "$merged"
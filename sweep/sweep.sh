@@ -0,0 +1,213 @@
+#!/bin/bash
+
+# Copyright: (C) 2026 iCub Facility - Istituto Italiano di Tecnologia
+# Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+# CopyPolicy: Released under the terms of the GNU GPL v3.0.
+
+# Run many grasp trials on parallel headless worlds: each worker owns its
+# name server, gazebo master and port prefix, so that workers don't interfere.
+# The stack of each worker is started once and reset between trials.
+
+workers=$(nproc)
+trials=100
+seed=0
+out_dir=$(pwd)/sweep-results
+world=""
+module_args=""
+carrier=tcp
+rpc_tmo=240
+
+# each name server hands out ports upward from its socket+2:
+# leave room for a whole stack between two workers
+port_span=1000
+
+# distance [m] the hand has to come within from the ball,
+# as in the proximity check of the smoke-test
+proximity=0.1
+
+usage() {
+    echo ""
+    echo "Usage: $0 [options]"
+    echo "--workers <n>    number of parallel worlds (default = number of cores)"
+    echo "--trials <n>     total number of trials (default = $trials)"
+    echo "--seed <n>       seed of the ball placements generator (default = $seed)"
+    echo "--out <dir>      where results are stored (default = $out_dir)"
+    echo "--world <file>   world to simulate (default = installed assignment_grasp-it.sdf)"
+    echo "--carrier <name>  carrier for the local connections, e.g. shmem (default = $carrier)"
+    echo "--module-args \"<args>\" further options for the module (e.g. grasp parameters)"
+    echo ""
+}
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --workers) workers=$2; shift ;;
+        --trials)  trials=$2; shift ;;
+        --seed)    seed=$2; shift ;;
+        --out)     out_dir=$2; shift ;;
+        --world)   world=$2; shift ;;
+        --module-args) module_args=$2; shift ;;
+        --carrier) carrier=$2; shift ;;
+        --help)    usage; exit 0 ;;
+        *)         usage; exit 1 ;;
+    esac
+    shift
+done
+
+# color codes
+red='\033[1;31m'
+green='\033[1;32m'
+nc='\033[0m'
+
+if [ -z "$world" ]; then
+    for dir in ${GAZEBO_RESOURCE_PATH//:/ } $(dirname $0)/../gazebo; do
+        if [ -f "$dir/worlds/assignment_grasp-it.sdf" ]; then
+            world="$dir/worlds/assignment_grasp-it.sdf"
+            break
+        fi
+    done
+fi
+if [ ! -f "$world" ]; then
+    echo -e "${red}Unable to find the world file${nc}"
+    exit 1
+fi
+
+mkdir -p "$out_dir"
+
+# same displacements the smoke-test applies to the initial ball position
+awk -v n=$trials -v seed=$seed 'BEGIN {
+    srand(seed);
+    for (i=0; i<n; i++)
+        printf("%d %.4f %.4f\n", i, -0.02*rand(), -0.05+0.1*rand());
+}' > "$out_dir/placements.txt"
+
+# wait for a port to show up within the current namespace
+wait_port() {
+    timeout ${2:-60} yarp wait $1 > /dev/null 2>&1
+}
+
+# send a command to an rpc port and print the response without the header
+rpc() {
+    echo "$2" | timeout $rpc_tmo yarp rpc $1 2> /dev/null | grep "Response:" | sed 's/Response: //'
+}
+
+# print the minimum distance of the poses streamed in the files $2... from the point $1
+min_distance() {
+    local p=($1)
+    shift
+    cat "$@" 2> /dev/null | tr -d '()' | awk -v x=${p[0]} -v y=${p[1]} -v z=${p[2]} 'NF>=3 {
+        d=sqrt(($1-x)^2+($2-y)^2+($3-z)^2);
+        if (m=="" || d<m) m=d;
+    }
+    END { print (m==""?1e3:m) }'
+}
+
+# bring up the whole stack of the worker and store its pids in stack
+start_stack() {
+    stack=()
+    gzserver -e dart "$log_dir/world.sdf" > "$log_dir/gzserver.log" 2>&1 & stack+=($!)
+    wait_port /icubSim/right_arm/state:o && wait_port /icubSim/left_arm/state:o
+    yarprobotinterface --context gazeboCartesianControl --config no_legs.xml > "$log_dir/robot.log" 2>&1 & stack+=($!)
+    sleep 2
+    iKinCartesianSolver --context gazeboCartesianControl --part right_arm > /dev/null 2>&1 & stack+=($!)
+    iKinCartesianSolver --context gazeboCartesianControl --part left_arm > /dev/null 2>&1 & stack+=($!)
+    iKinGazeCtrl --context gazeboCartesianControl --from iKinGazeCtrl.ini > /dev/null 2>&1 & stack+=($!)
+    wait_port /icubSim/cartesianController/right_arm/state:o && \
+    wait_port /icubSim/cartesianController/left_arm/state:o && wait_port /iKinGazeCtrl/rpc
+    assignment_grasp-it --robot icubSim --prefix $prefix $module_args >> "$log_dir/module.log" 2>&1 & stack+=($!)
+    wait_port $prefix/service && yarp connect $prefix/location $ball $carrier > /dev/null 2>&1
+
+    # the resting position of the ball the placements refer to
+    home_pos=($(rpc $ball "get"))
+}
+
+stop_stack() {
+    kill -INT ${stack[@]} 2> /dev/null
+    wait ${stack[@]} 2> /dev/null
+}
+
+# run all the trials assigned to worker $1
+worker() {
+    local k=$1
+    log_dir="$out_dir/worker-$k"
+    prefix="/w$k"
+    mkdir -p "$log_dir"
+
+    # isolate yarp and gazebo
+    export YARP_NAMESPACE="/grasp-it-w$k"
+    export GAZEBO_MASTER_URI="http://localhost:$((11345+k))"
+    yarpserver --socket $((10000+port_span*k)) --write > "$log_dir/yarpserver.log" 2>&1 &
+    local server=$!
+    sleep 2
+
+    sed "s|<plugin name=\"mover\" filename='libassignment_grasp-it-world.so'/>|<plugin name=\"mover\" filename='libassignment_grasp-it-world.so'><prefix>$prefix</prefix></plugin>|" \
+        "$world" > "$log_dir/world.sdf"
+
+    ball="$prefix/assignment_grasp-it-ball/rpc"
+    local csv="$log_dir/results.csv"
+    : > "$csv"
+
+    start_stack
+    while read trial dx dy; do
+        [ $((trial % workers)) -eq $k ] || continue
+
+        # bring the stack up again only if something went down
+        if [ "${home_pos[0]}" != "[ack]" ] || ! yarp exists $prefix/service > /dev/null 2>&1; then
+            echo -e "${red}[worker $k] restarting the stack${nc}"
+            stop_stack
+            start_stack
+        fi
+
+        local result="fail"
+        if [ "${home_pos[0]}" == "[ack]" ] && [ "$(rpc $prefix/service "home" | cut -d' ' -f1)" == "ack" ]; then
+            local x=$(echo "${home_pos[1]} + $dx" | bc -l)
+            local y=$(echo "${home_pos[2]} + $dy" | bc -l)
+            local z0=${home_pos[3]}
+            rpc $ball "set $x $y $z0" > /dev/null
+            sleep 1
+
+            # stream the hands poses throughout grasp_it
+            local readers=()
+            for arm in right_arm left_arm; do
+                yarp read $prefix/sweep/$arm > "$log_dir/$arm.txt" 2> /dev/null & readers+=($!)
+                wait_port $prefix/sweep/$arm 10 && \
+                yarp connect /icubSim/cartesianController/$arm/state:o $prefix/sweep/$arm $carrier > /dev/null 2>&1
+            done
+
+            local t0=$(date +%s.%N)
+            local look=($(rpc $prefix/service "look_down"))
+            local t1=$(date +%s.%N)
+            local grasp=($(rpc $prefix/service "grasp_it"))
+            local t2=$(date +%s.%N)
+            local pos=($(rpc $ball "get"))
+
+            kill -INT ${readers[@]} 2> /dev/null
+            wait ${readers[@]} 2> /dev/null
+
+            # ball position in robot's root frame
+            local d=$(min_distance "$x $y $(echo "$z0 - 0.63" | bc -l)" "$log_dir"/right_arm.txt "$log_dir"/left_arm.txt)
+            local dz=$(echo "${pos[3]} - $z0" | bc -l)
+            if [ "${look[0]}" == "ack" ] && [ "${grasp[0]}" == "ack" ] && \
+               [ $(echo "$d < $proximity" | bc -l) -eq 1 ] && \
+               [ $(echo "$dz >= 0.02" | bc -l) -eq 1 ]; then
+                result="success"
+            fi
+            printf "%d,%d,%s,%s,%s,%.3f,%.3f,%.4f,%.4f\n" $k $trial $result $dx $dy \
+                   $(echo "$t1 - $t0" | bc -l) $(echo "$t2 - $t1" | bc -l) $dz $d >> "$csv"
+        else
+            printf "%d,%d,%s,%s,%s,,,,\n" $k $trial "error" $dx $dy >> "$csv"
+        fi
+        echo -e "[worker $k] trial $trial: $result"
+    done < "$out_dir/placements.txt"
+
+    stop_stack
+    kill -INT $server 2> /dev/null
+    wait $server 2> /dev/null
+}
+
+echo -e "${green}Running $trials trials on $workers worlds${nc}"
+for ((k=0; k<workers; k++)); do
+    worker $k &
+done
+wait
+
+$(dirname $0)/aggregate.sh "$out_dir"